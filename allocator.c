@@ -25,16 +25,603 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include "./allocator_interface.h"
 #include "./memlib.h"
 
+// Every strategy is compiled in (range_allocator.c, pow2_allocator.c,
+// buddy_allocator.c, tlsf_allocator.c and arena_allocator.c), and my_init
+// picks one.  The MALLOC_STRATEGY environment variable names it directly.
+// Otherwise the TRACE_CLASS environment variable, and failing that the
+// TRACE_CLASS the build was tuned for, picks the strategy that suits the
+// class, and range and pow2 take that class's parameters at init.
+//
+// With no trace class at all the "auto" strategy fingerprints the
+// workload instead.  TLSF serves the first PROBE_OPS requests while their
+// sizes are recorded.  If the fingerprint then looks like a fixed-class
+// workload, pow2 takes over the rest of the heap, and blocks below the
+// switch point are still freed by TLSF.  A THREAD_SAFE build uses the
+// arenas instead.
+
 // Trace classes are numbered 0..10. Use default value of -1.
 #ifndef TRACE_CLASS
 #define TRACE_CLASS -1
 #endif
 
-#if TRACE_CLASS == 3 || TRACE_CLASS == 6 
-#include "./pow2_alloc.h"
+// Set to 1 to use the binary buddy allocator unless told otherwise.
+#ifndef BUDDY_ALLOC
+#define BUDDY_ALLOC 0
+#endif
+
+// Set to 1 for a build that several threads may call at once.  Every
+// strategy call then holds heap_lock, unless the strategy locks its own
+// arenas, and each thread keeps a cache of freed blocks (its tcache) that
+// it reuses without locking or atomics.
+#ifndef THREAD_SAFE
+#define THREAD_SAFE 0
+#endif
+
+// The tcache holds blocks of up to TCACHE_MAX_SIZE usable bytes, in
+// classes TCACHE_GRAIN bytes apart, and at most TCACHE_COUNT per class.
+// Frees beyond that go back to the shared heap.
+#ifndef TCACHE_MAX_SIZE
+#define TCACHE_MAX_SIZE 1024
+#endif
+#ifndef TCACHE_COUNT
+#define TCACHE_COUNT 7
+#endif
+#define TCACHE_GRAIN 16
+#define TCACHE_BINS (TCACHE_MAX_SIZE / TCACHE_GRAIN + 1)
+
+// Set to 1, with THREAD_SAFE, to cache the tcache's classes per CPU
+// instead, so that a thousand threads on four cores keep four caches.
+// A thread pushes and pops its CPU's cache in a restartable sequence
+// (rseq): the kernel restarts it if the thread is preempted or migrated
+// before the store that commits it, so it needs no atomics.  The
+// sequences are x86-64 assembly, and threads glibc has not registered
+// with rseq use their tcache.
+#ifndef PERCPU_CACHE
+#define PERCPU_CACHE 0
+#endif
+#if PERCPU_CACHE && !(THREAD_SAFE && defined(__x86_64__) && \
+                      defined(__linux__) && __has_include(<sys/rseq.h>))
+#undef PERCPU_CACHE
+#define PERCPU_CACHE 0
+#endif
+
+// At most this many blocks per class per CPU.
+#ifndef PCACHE_COUNT
+#define PCACHE_COUNT 32
+#endif
+
+// Number of requests (malloc, realloc and free) to fingerprint.
+#ifndef PROBE_OPS
+#define PROBE_OPS 512
+#endif
+
+// The fingerprint ends early once the heap grows past this, since the
+// probe's part of the heap is lost to the strategy that takes over.
+#ifndef PROBE_HEAP
+#define PROBE_HEAP (1 << 14)
+#endif
+
+typedef struct {
+  const char *name;
+  const malloc_impl_t *impl;
+} strategy_t;
+
+// Serves the fingerprinting requests, then hands over; see below.
+static const malloc_impl_t auto_impl;
+
+static const strategy_t strategies[] = {
+  {"range", &range_impl},
+  {"pow2", &pow2_impl},
+  {"buddy", &buddy_impl},
+  {"tlsf", &tlsf_impl},
+  {"auto", &auto_impl},
+  {"arena", &arena_impl},
+};
+#define NUM_STRATEGIES (sizeof(strategies) / sizeof(strategies[0]))
+
+// The strategy in use, chosen by my_init.
+static const malloc_impl_t *strategy = &range_impl;
+
+// Blocks below switch_brk belong to probe_impl, the strategy that served
+// the fingerprint.  switch_brk stays NULL unless the strategy changed.
+// A thread-safe build reads all three without the lock when it caches a
+// freed block, so probe_step publishes them atomically, strategy last.
+static char *switch_brk;
+static const malloc_impl_t *probe_impl;
+
+static inline int probe_owns(void *ptr) {
+  return ptr != NULL &&
+         (char*)ptr < __atomic_load_n(&switch_brk, __ATOMIC_RELAXED);
+}
+
+// What the fingerprint records about the first requests.
+static struct {
+  size_t ops;
+  size_t allocs;
+  size_t reallocs;
+  size_t aligned;
+  size_t frees;
+  size_t pow2;
+  size_t sum_lg;
+  size_t sum_lg2;
+  char *heap_lo;
+} probe;
+
+static inline void probe_size(size_t size) {
+  size_t lg = size ? 63 - __builtin_clzl(size) : 0;
+  probe.allocs++;
+  probe.pow2 += size && !(size & (size - 1));
+  probe.sum_lg += lg;
+  probe.sum_lg2 += lg * lg;
+}
+
+// Picks the strategy for the rest of the run.  pow2's fixed classes win
+// when a good share of the sizes are exact powers of two spread over
+// several octaves, and nothing is realloced or aligned: those blocks
+// never need splitting or coalescing.  A stream of nothing but powers of
+// two is better served by TLSF, which can reuse a freed block for any
+// smaller class.  So is everything else.
+static const malloc_impl_t *fingerprint_strategy() {
+  size_t n = probe.allocs;
+  if (!n || probe.reallocs || probe.aligned)
+    return &tlsf_impl;
+  // Variance of lg(size), scaled by n * n.
+  size_t var = n * probe.sum_lg2 - probe.sum_lg * probe.sum_lg;
+  if (8 * probe.pow2 >= 3 * n && 4 * probe.pow2 <= 3 * n && var >= n * n)
+    return &pow2_impl;
+  return &tlsf_impl;
+}
+
+// Counts a request, and once the fingerprint is done, switches strategy.
+static inline void probe_step() {
+  if (++probe.ops < PROBE_OPS &&
+      (char*)mem_heap_hi() + 1 - probe.heap_lo < PROBE_HEAP)
+    return;
+  const malloc_impl_t *next = fingerprint_strategy();
+  if (next != &tlsf_impl) {
+    char *brk = (char*)mem_heap_hi() + 1;
+    if (next->init() < 0) {
+      next = &tlsf_impl;
+    } else {
+      __atomic_store_n(&probe_impl, &tlsf_impl, __ATOMIC_RELAXED);
+      __atomic_store_n(&switch_brk, brk, __ATOMIC_RELAXED);
+    }
+  }
+  __atomic_store_n(&strategy, next, __ATOMIC_RELEASE);
+}
+
+static int auto_init() {
+  memset(&probe, 0, sizeof(probe));
+  probe.heap_lo = (char*)mem_heap_hi() + 1;
+  return tlsf_impl.init();
+}
+
+static void * auto_malloc(size_t size) {
+  probe_size(size);
+  void *p = tlsf_impl.malloc(size);
+  probe_step();
+  return p;
+}
+
+static void * auto_realloc(void *ptr, size_t size) {
+  probe.reallocs++;
+  probe_size(size);
+  void *p = tlsf_impl.realloc(ptr, size);
+  probe_step();
+  return p;
+}
+
+static void * auto_memalign(size_t alignment, size_t size) {
+  probe.aligned++;
+  probe_size(size);
+  void *p = tlsf_impl.memalign(alignment, size);
+  probe_step();
+  return p;
+}
+
+static void auto_free(void *ptr) {
+  probe.frees++;
+  tlsf_impl.free(ptr);
+  probe_step();
+}
+
+static const malloc_impl_t auto_impl = {
+  .init = &auto_init, .malloc = &auto_malloc, .realloc = &auto_realloc,
+  .free = &auto_free, .check = &tlsf_check, .reset_brk = &tlsf_reset_brk,
+  .heap_lo = &tlsf_heap_lo, .heap_hi = &tlsf_heap_hi,
+  .usable_size = &tlsf_usable_size, .memalign = &auto_memalign};
+
+// Returns the strategy for a trace class.
+static const malloc_impl_t *class_strategy(int trace_class) {
+  if (BUDDY_ALLOC)
+    return &buddy_impl;
+  if (trace_class == 3 || trace_class == 6)
+    return &pow2_impl;
+  return &range_impl;
+}
+
+// The trace class to tune for: the TRACE_CLASS environment variable, or
+// failing that the class the build was tuned for, -1 if none.
+static int select_class() {
+  const char *trace_class = getenv("TRACE_CLASS");
+  return trace_class ? atoi(trace_class) : TRACE_CLASS;
+}
+
+// Looks the strategy up once, from the environment or the build.
+static const malloc_impl_t *select_strategy() {
+  static const malloc_impl_t *selected;
+  if (selected)
+    return selected;
+
+  const char *name = getenv("MALLOC_STRATEGY");
+  if (name) {
+    for (size_t i = 0; i < NUM_STRATEGIES; i++) {
+      if (!strcmp(name, strategies[i].name))
+        return selected = strategies[i].impl;
+    }
+    fprintf(stderr, "Unknown MALLOC_STRATEGY '%s'\n", name);
+  }
+  int trace_class = select_class();
+  if (trace_class < 0 && !BUDDY_ALLOC)
+    return selected = THREAD_SAFE ? &arena_impl : &auto_impl;
+  return selected = class_strategy(trace_class);
+}
+
+// The strategy that allocated ptr.  Until strategy changes, every block
+// belongs to it, whatever switch_brk says.
+static inline const malloc_impl_t *owner(void *ptr) {
+  const malloc_impl_t *s = __atomic_load_n(&strategy, __ATOMIC_ACQUIRE);
+  return probe_owns(ptr) ? __atomic_load_n(&probe_impl, __ATOMIC_RELAXED) : s;
+}
+
+#if THREAD_SAFE
+// Set when the strategy does its own locking, per arena.
+static int self_locked;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() \
+  do { if (!self_locked) pthread_mutex_lock(&heap_lock); } while (0)
+#define UNLOCK() \
+  do { if (!self_locked) pthread_mutex_unlock(&heap_lock); } while (0)
+
+typedef struct TcacheNode {
+  struct TcacheNode *next;
+} TcacheNode;
+
+typedef struct {
+  TcacheNode *head[TCACHE_BINS];
+  unsigned count[TCACHE_BINS];
+  // The heap_epoch the blocks were cached in.
+  size_t epoch;
+} Tcache;
+
+static __thread Tcache tcache;
+
+// my_init starts a new epoch, which drops every thread's cached blocks
+// along with the old heap.
+static size_t heap_epoch;
+
+// Returns a thread's cached blocks to the heap when it exits.
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+
+static void tcache_flush(void *arg) {
+  Tcache *t = (Tcache *)arg;
+  if (t->epoch != heap_epoch)
+    return;
+  LOCK();
+  for (int i = 0; i < TCACHE_BINS; i++) {
+    while (t->head[i]) {
+      TcacheNode *n = t->head[i];
+      t->head[i] = n->next;
+      owner(n)->free(n);
+    }
+    t->count[i] = 0;
+  }
+  UNLOCK();
+}
+
+static void tcache_key_create() {
+  pthread_key_create(&tcache_key, tcache_flush);
+}
+
+// Takes a cached block for size bytes, or returns NULL.  A block in bin
+// i has at least i * TCACHE_GRAIN usable bytes.
+static inline void * tcache_get(size_t size) {
+  size_t i = (size + TCACHE_GRAIN - 1) / TCACHE_GRAIN;
+  if (i >= TCACHE_BINS || tcache.epoch != heap_epoch || !tcache.head[i])
+    return NULL;
+  TcacheNode *n = tcache.head[i];
+  tcache.head[i] = n->next;
+  tcache.count[i]--;
+  return n;
+}
+
+// Caches ptr if it is small and its bin has room.  Returns 1 if it did.
+static inline int tcache_put(void *ptr) {
+  size_t i = owner(ptr)->usable_size(ptr) / TCACHE_GRAIN;
+  if (i >= TCACHE_BINS)
+    return 0;
+  if (tcache.epoch != heap_epoch) {
+    memset(&tcache, 0, sizeof(tcache));
+    tcache.epoch = heap_epoch;
+    pthread_once(&tcache_once, tcache_key_create);
+    pthread_setspecific(tcache_key, &tcache);
+  }
+  if (tcache.count[i] == TCACHE_COUNT)
+    return 0;
+  TcacheNode *n = (TcacheNode *)ptr;
+  n->next = tcache.head[i];
+  tcache.head[i] = n;
+  tcache.count[i]++;
+  return 1;
+}
+
+#if PERCPU_CACHE
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/rseq.h>
+#include <unistd.h>
+
+// One class of one CPU's cache: a stack of up to PCACHE_COUNT blocks.
+// The sequences below rely on count being the first word.
+typedef struct {
+  long count;
+  void *slot[PCACHE_COUNT];
+} Slab;
+
+typedef struct {
+  Slab bin[TCACHE_BINS];
+} Pcache;
+
+// One Pcache per configured CPU, mapped by the first my_init.
+static Pcache *pcache;
+static long pcache_cpus;
+
+static inline struct rseq *rseq_area() {
+  return (struct rseq *)((char *)__builtin_thread_pointer() + __rseq_offset);
+}
+
+// Whether this thread can use the per-CPU cache.  glibc leaves cpu_id
+// negative, which is huge unsigned, if it did not register the thread.
+static inline int pcache_usable() {
+  return pcache && rseq_area()->cpu_id < (unsigned long)pcache_cpus;
+}
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+// The critical section runs from 1 to 2.  Its descriptor (3) tells the
+// kernel to abort to 4, which is preceded by glibc's signature and
+// starts over at 5, since an abort clears rseq_cs.
+#define RSEQ_CS_DESCRIPTOR \
+  ".pushsection __rseq_cs, \"aw\"\n\t" \
+  ".balign 32\n\t" \
+  "3:\n\t" \
+  ".long 0, 0\n\t" \
+  ".quad 1f, 2f - 1f, 4f\n\t" \
+  ".popsection\n\t" \
+  "5:\n\t" \
+  "leaq 3b(%%rip), %%rax\n\t" \
+  "movq %%rax, %c[cs](%[rseq])\n\t" \
+  "1:\n\t"
+#define RSEQ_ABORT \
+  "2:\n\t" \
+  ".pushsection __rseq_failure, \"ax\"\n\t" \
+  ".byte 0x0f, 0xb9, 0x3d\n\t" \
+  ".long " STR(RSEQ_SIG) "\n\t" \
+  "4:\n\t" \
+  "jmp 5b\n\t" \
+  ".popsection\n\t"
+// Leaves the thread's CPU's slab of the class at base in rax.
+#define RSEQ_SLAB \
+  "movl %c[cpu](%[rseq]), %%eax\n\t" \
+  "imulq %[stride], %%rax\n\t" \
+  "addq %[base], %%rax\n\t"
+#define RSEQ_OPERANDS(i) \
+  [rseq] "r" (rseq_area()), [base] "r" (&pcache->bin[i]), \
+  [stride] "i" (sizeof(Pcache)), \
+  [cs] "i" (offsetof(struct rseq, rseq_cs)), \
+  [cpu] "i" (offsetof(struct rseq, cpu_id))
+
+// Pops a block of bin i from the thread's CPU, or returns NULL.
+static inline void * pcache_pop(size_t i) {
+  void *p;
+  __asm__ __volatile__(
+      RSEQ_CS_DESCRIPTOR
+      "xorl %k[p], %k[p]\n\t"
+      RSEQ_SLAB
+      "movq (%%rax), %%rcx\n\t"
+      "testq %%rcx, %%rcx\n\t"
+      "jz 2f\n\t"
+      "movq (%%rax,%%rcx,8), %[p]\n\t"
+      "decq %%rcx\n\t"
+      "movq %%rcx, (%%rax)\n\t"
+      RSEQ_ABORT
+      : [p] "=&r" (p)
+      : RSEQ_OPERANDS(i)
+      : "rax", "rcx", "memory", "cc");
+  return p;
+}
+
+// Pushes ptr on bin i of the thread's CPU.  Returns 0 if the bin is full.
+static inline int pcache_push(size_t i, void *ptr) {
+  int ok;
+  __asm__ __volatile__(
+      RSEQ_CS_DESCRIPTOR
+      "xorl %[ok], %[ok]\n\t"
+      RSEQ_SLAB
+      "movq (%%rax), %%rcx\n\t"
+      "cmpq %[max], %%rcx\n\t"
+      "jae 2f\n\t"
+      "movq %[ptr], 8(%%rax,%%rcx,8)\n\t"
+      "incq %%rcx\n\t"
+      "movl $1, %[ok]\n\t"
+      "movq %%rcx, (%%rax)\n\t"
+      RSEQ_ABORT
+      : [ok] "=&r" (ok)
+      : RSEQ_OPERANDS(i), [ptr] "r" (ptr), [max] "i" (PCACHE_COUNT)
+      : "rax", "rcx", "memory", "cc");
+  return ok;
+}
+
+// Maps the caches on first use and empties them, along with the old
+// heap, after.
+static void pcache_init() {
+  if (!pcache && __rseq_size > 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    void *p = mmap(NULL, cpus * sizeof(Pcache), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED) {
+      pcache = (Pcache *)p;
+      pcache_cpus = cpus;
+    }
+    return;
+  }
+  if (pcache)
+    memset(pcache, 0, pcache_cpus * sizeof(Pcache));
+}
+#endif
+
+// Takes a cached block for size bytes, from the thread's CPU's cache if
+// it can use one.
+static inline void * cache_get(size_t size) {
+#if PERCPU_CACHE
+  if (pcache_usable()) {
+    size_t i = (size + TCACHE_GRAIN - 1) / TCACHE_GRAIN;
+    return i < TCACHE_BINS ? pcache_pop(i) : NULL;
+  }
+#endif
+  return tcache_get(size);
+}
+
+// Caches ptr, in the thread's CPU's cache if it can use one.  Returns 1
+// if it did.
+static inline int cache_put(void *ptr) {
+#if PERCPU_CACHE
+  if (pcache_usable()) {
+    size_t i = owner(ptr)->usable_size(ptr) / TCACHE_GRAIN;
+    return i < TCACHE_BINS && pcache_push(i, ptr);
+  }
+#endif
+  return tcache_put(ptr);
+}
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+
+int my_init() {
+  strategy = select_strategy();
+#if THREAD_SAFE
+  heap_epoch++;
+  self_locked = strategy == &arena_impl;
+#endif
+#if PERCPU_CACHE
+  pcache_init();
+#endif
+  switch_brk = NULL;
+  int trace_class = select_class();
+  range_set_class(trace_class);
+  pow2_set_class(trace_class);
+  return strategy->init();
+}
+
+void * my_malloc(size_t size) {
+  void *p;
+#if THREAD_SAFE
+  if ((p = cache_get(size)))
+    return p;
+#endif
+  LOCK();
+  p = strategy->malloc(size);
+  UNLOCK();
+  return p;
+}
+
+// A block the probe strategy still owns moves to the current one.
+static void * heap_realloc(void *ptr, size_t size) {
+  if (!probe_owns(ptr))
+    return strategy->realloc(ptr, size);
+  void *newptr = strategy->malloc(size);
+  if (newptr == NULL)
+    return NULL;
+  size_t old_size = probe_impl->usable_size(ptr);
+  memcpy(newptr, ptr, size < old_size ? size : old_size);
+  probe_impl->free(ptr);
+  return newptr;
+}
+
+void * my_realloc(void *ptr, size_t size) {
+  if (!ptr)
+    return my_malloc(size);
+  LOCK();
+  void *p = heap_realloc(ptr, size);
+  UNLOCK();
+  return p;
+}
+
+// Alignments up to the strategies' own 8 bytes are plain mallocs.  Above
+// that, a strategy without memalign fails the request.
+void * my_memalign(size_t alignment, size_t size) {
+  if (alignment & (alignment - 1))
+    return NULL;
+  if (alignment <= 8)
+    return my_malloc(size);
+  if (!strategy->memalign)
+    return NULL;
+  LOCK();
+  void *p = strategy->memalign(alignment, size);
+  UNLOCK();
+  return p;
+}
+
+void * my_calloc(size_t nmemb, size_t size) {
+  size_t bytes;
+  if (__builtin_mul_overflow(nmemb, size, &bytes))
+    return NULL;
+  void *p = my_malloc(bytes);
+  if (p)
+    memset(p, 0, bytes);
+  return p;
+}
+
+void my_free(void *ptr) {
+#if THREAD_SAFE
+  if (ptr == NULL || cache_put(ptr))
+    return;
+#endif
+  LOCK();
+  owner(ptr)->free(ptr);
+  UNLOCK();
+}
+
+int my_check() {
+  LOCK();
+  int ret = strategy->check();
+  UNLOCK();
+  return ret;
+}
+
+void my_reset_brk() {
+  strategy->reset_brk();
+}
+
+void * my_heap_lo() {
+  return strategy->heap_lo();
+}
+
+void * my_heap_hi() {
+  return strategy->heap_hi();
+}
+
+int my_percpu_cache() {
+#if PERCPU_CACHE
+  return pcache_usable();
 #else
-#include "./range_alloc.h"
+  return 0;
 #endif
+}
@@ -38,6 +38,15 @@ typedef struct {
   void (*reset_brk)(void);
   void *(*heap_lo)(void);
   void *(*heap_hi)(void);
+  /* Bytes usable at a block it allocated.  Only the strategies below
+   * provide it. */
+  size_t (*usable_size)(void *ptr);
+  /* A block of size bytes aligned to alignment, a power of two.  NULL
+   * where the package has none. */
+  void *(*memalign)(size_t alignment, size_t size);
+  /* Zeroed room for nmemb objects of size bytes.  NULL where the package
+   * has none. */
+  void *(*calloc)(size_t nmemb, size_t size);
 } malloc_impl_t;
 
 int libc_init();
@@ -48,11 +57,14 @@ int libc_check();
 void libc_reset_brk();
 void * libc_heap_lo();
 void * libc_heap_hi();
+void * libc_memalign(size_t alignment, size_t size);
+void * libc_calloc(size_t nmemb, size_t size);
 
 static const malloc_impl_t libc_impl =
 { .init = &libc_init, .malloc = &libc_malloc, .realloc = &libc_realloc,
   .free = &libc_free, .check = &libc_check, .reset_brk = &libc_reset_brk,
-  .heap_lo = &libc_heap_lo, .heap_hi = &libc_heap_hi};
+  .heap_lo = &libc_heap_lo, .heap_hi = &libc_heap_hi,
+  .memalign = &libc_memalign, .calloc = &libc_calloc};
 
 int my_init();
 void * my_malloc(size_t size);
@@ -62,11 +74,19 @@ int my_check();
 void my_reset_brk();
 void * my_heap_lo();
 void * my_heap_hi();
+void * my_memalign(size_t alignment, size_t size);
+void * my_calloc(size_t nmemb, size_t size);
 
 static const malloc_impl_t my_impl =
 { .init = &my_init, .malloc = &my_malloc, .realloc = &my_realloc,
   .free = &my_free, .check = &my_check, .reset_brk = &my_reset_brk,
-  .heap_lo = &my_heap_lo, .heap_hi = &my_heap_hi};
+  .heap_lo = &my_heap_lo, .heap_hi = &my_heap_hi,
+  .memalign = &my_memalign, .calloc = &my_calloc};
+
+/* Nonzero if the calling thread caches small blocks per CPU (PERCPU=1)
+ * rather than per thread.
+ */
+int my_percpu_cache();
 
 int bad_init();
 void * bad_malloc(size_t size);
@@ -82,4 +102,108 @@ static const malloc_impl_t bad_impl =
   .free = &bad_free, .check = &bad_check, .reset_brk = &bad_reset_brk,
   .heap_lo = &bad_heap_lo, .heap_hi = &bad_heap_hi};
 
+/* The strategies allocator.c chooses between at runtime.  Each is also
+ * a complete malloc package on its own.  buddy has no memalign: its
+ * payloads follow an 8-byte header.
+ */
+int range_init();
+void * range_malloc(size_t size);
+void * range_realloc(void *ptr, size_t size);
+void range_free(void *ptr);
+int range_check();
+void range_reset_brk();
+void * range_heap_lo();
+void * range_heap_hi();
+size_t range_usable_size(void *ptr);
+void * range_memalign(size_t alignment, size_t size);
+/* Tunes the heaps range_init lays down from now on for a trace class, or
+ * for none if it is -1. */
+void range_set_class(int trace_class);
+
+static const malloc_impl_t range_impl =
+{ .init = &range_init, .malloc = &range_malloc, .realloc = &range_realloc,
+  .free = &range_free, .check = &range_check, .reset_brk = &range_reset_brk,
+  .heap_lo = &range_heap_lo, .heap_hi = &range_heap_hi,
+  .usable_size = &range_usable_size, .memalign = &range_memalign};
+
+int pow2_init();
+void * pow2_malloc(size_t size);
+void * pow2_realloc(void *ptr, size_t size);
+void pow2_free(void *ptr);
+int pow2_check();
+void pow2_reset_brk();
+void * pow2_heap_lo();
+void * pow2_heap_hi();
+size_t pow2_usable_size(void *ptr);
+void * pow2_memalign(size_t alignment, size_t size);
+void pow2_set_class(int trace_class);
+
+static const malloc_impl_t pow2_impl =
+{ .init = &pow2_init, .malloc = &pow2_malloc, .realloc = &pow2_realloc,
+  .free = &pow2_free, .check = &pow2_check, .reset_brk = &pow2_reset_brk,
+  .heap_lo = &pow2_heap_lo, .heap_hi = &pow2_heap_hi,
+  .usable_size = &pow2_usable_size, .memalign = &pow2_memalign};
+
+int buddy_init();
+void * buddy_malloc(size_t size);
+void * buddy_realloc(void *ptr, size_t size);
+void buddy_free(void *ptr);
+int buddy_check();
+void buddy_reset_brk();
+void * buddy_heap_lo();
+void * buddy_heap_hi();
+size_t buddy_usable_size(void *ptr);
+
+static const malloc_impl_t buddy_impl =
+{ .init = &buddy_init, .malloc = &buddy_malloc, .realloc = &buddy_realloc,
+  .free = &buddy_free, .check = &buddy_check, .reset_brk = &buddy_reset_brk,
+  .heap_lo = &buddy_heap_lo, .heap_hi = &buddy_heap_hi,
+  .usable_size = &buddy_usable_size};
+
+int tlsf_init();
+void * tlsf_malloc(size_t size);
+void * tlsf_realloc(void *ptr, size_t size);
+void tlsf_free(void *ptr);
+int tlsf_check();
+void tlsf_reset_brk();
+void * tlsf_heap_lo();
+void * tlsf_heap_hi();
+size_t tlsf_usable_size(void *ptr);
+void * tlsf_memalign(size_t alignment, size_t size);
+
+static const malloc_impl_t tlsf_impl =
+{ .init = &tlsf_init, .malloc = &tlsf_malloc, .realloc = &tlsf_realloc,
+  .free = &tlsf_free, .check = &tlsf_check, .reset_brk = &tlsf_reset_brk,
+  .heap_lo = &tlsf_heap_lo, .heap_hi = &tlsf_heap_hi,
+  .usable_size = &tlsf_usable_size, .memalign = &tlsf_memalign};
+
+int arena_init();
+void * arena_malloc(size_t size);
+void * arena_realloc(void *ptr, size_t size);
+void arena_free(void *ptr);
+int arena_check();
+void arena_reset_brk();
+void * arena_heap_lo();
+void * arena_heap_hi();
+size_t arena_usable_size(void *ptr);
+void * arena_memalign(size_t alignment, size_t size);
+
+static const malloc_impl_t arena_impl =
+{ .init = &arena_init, .malloc = &arena_malloc, .realloc = &arena_realloc,
+  .free = &arena_free, .check = &arena_check, .reset_brk = &arena_reset_brk,
+  .heap_lo = &arena_heap_lo, .heap_hi = &arena_heap_hi,
+  .usable_size = &arena_usable_size, .memalign = &arena_memalign};
+
+/* The arenas with every free taking the owning arena's lock, which
+ * mdriver -P compares against the remote-free lists.
+ */
+void arena_free_locked(void *ptr);
+
+static const malloc_impl_t arena_locked_impl =
+{ .init = &arena_init, .malloc = &arena_malloc, .realloc = &arena_realloc,
+  .free = &arena_free_locked, .check = &arena_check,
+  .reset_brk = &arena_reset_brk, .heap_lo = &arena_heap_lo,
+  .heap_hi = &arena_heap_hi, .usable_size = &arena_usable_size,
+  .memalign = &arena_memalign};
+
 #endif  // _ALLOCATOR_INTERFACE_H
@@ -0,0 +1,434 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "./allocator_interface.h"
+#include "./config.h"
+#include "./memlib.h"
+#include "./tlsf.h"
+
+// Don't call libc malloc!
+#define malloc(...) (USE_ARENA_MALLOC)
+#define free(...) (USE_ARENA_FREE)
+#define realloc(...) (USE_ARENA_REALLOC)
+
+// Independent arenas for threaded programs.  Each arena is a TLSF pool
+// with its own lock, over chunks it carves from the heap with mem_sbrk.
+// Every chunk starts with a prologue and ends with an epilogue, so blocks
+// never coalesce across chunks.  Chunks start on an ARENA_PAGE boundary,
+// and ChunkArena maps each page of the heap to the arena whose chunk
+// starts in or covers it.
+//
+// Threads take arenas round-robin, and move to another arena when theirs
+// is busy.  An arena that runs out of free blocks first takes a fit from
+// any idle arena before it grows the heap, so one thread's surplus is not
+// stranded while another thread's arena keeps growing.  The arena whose
+// chunk is last in the heap grows by extending it, as TLSF grows its top
+// block; any other arena carves a new chunk.
+//
+// A thread that frees a block of an arena other than its own does not
+// take that arena's lock.  It pushes the block on the arena's remote
+// list, a lock-free stack that the owner drains in one exchange whenever
+// it holds its lock.  arena_locked_impl frees under the owner's lock
+// instead, for comparison.
+
+// Number of arenas.
+#ifndef NUM_ARENAS
+#define NUM_ARENAS 4
+#endif
+
+// An arena grows by at least this many bytes at a time.
+#ifndef ARENA_GROW
+#define ARENA_GROW (1 << 14)
+#endif
+
+// Chunks start on a boundary of this many bytes.
+#define ARENA_PAGE 4096
+#define NUM_PAGES (MAX_HEAP / ARENA_PAGE + 1)
+
+_Static_assert(NUM_ARENAS <= 255, "ChunkArena holds arena indices in a byte");
+
+typedef struct {
+  Pool pool;
+  pthread_mutex_t lock;
+  // Blocks other threads freed, linked through next, not yet in pool.
+  Block* remote;
+} Arena;
+
+static Arena arenas[NUM_ARENAS];
+static pthread_once_t arenas_once = PTHREAD_ONCE_INIT;
+static uint8_t ChunkArena[NUM_PAGES];
+// The first chunk, ARENA_PAGE-aligned.
+static char* chunk_base;
+// Held while the heap grows, so that the last chunk stays last.
+static pthread_mutex_t grow_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The arena each thread last used, or -1 before its first malloc.
+static __thread int thread_arena = -1;
+static unsigned next_arena;
+
+static inline size_t page_of(void *p) {
+  return ((char*)p - chunk_base) / ARENA_PAGE;
+}
+
+static inline Arena* arena_of(Block* b) {
+  return &arenas[ChunkArena[page_of(b)]];
+}
+
+// Pushes b on a's remote list.  Any thread may call this without a lock.
+static inline void push_remote(Arena* a, Block* b) {
+  Block* head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+  do {
+    b->next = head;
+  } while (!__atomic_compare_exchange_n(&a->remote, &head, b, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Frees every block on a's remote list.  Needs a's lock.
+static inline void drain_remote(Arena* a) {
+  if (!__atomic_load_n(&a->remote, __ATOMIC_RELAXED))
+    return;
+  Block* b = __atomic_exchange_n(&a->remote, NULL, __ATOMIC_ACQUIRE);
+  while (b) {
+    Block* next = b->next;
+    free_block(&a->pool, b);
+    b = next;
+  }
+}
+
+// Locks an arena for the calling thread: its own if it is free, else the
+// first idle one, which it keeps from then on.  If every arena is busy,
+// waits for its own.
+static Arena* lock_arena() {
+  if (thread_arena < 0)
+    thread_arena = __sync_fetch_and_add(&next_arena, 1) % NUM_ARENAS;
+  for (int i = 0; i < NUM_ARENAS; i++) {
+    int a = (thread_arena + i) % NUM_ARENAS;
+    if (pthread_mutex_trylock(&arenas[a].lock) == 0) {
+      thread_arena = a;
+      return &arenas[a];
+    }
+  }
+  pthread_mutex_lock(&arenas[thread_arena].lock);
+  return &arenas[thread_arena];
+}
+
+// Takes a free block of at least aligned_size bytes from p, marks it used
+// and trims it.  Returns NULL if p has none.
+static Block* take_block(Pool* p, size_t aligned_size) {
+  int fl, sl;
+  mapping_search(aligned_size, &fl, &sl);
+  Block* b = search_suitable(p, &fl, &sl);
+  if (!b)
+    return NULL;
+  remove_block(p, b);
+  mark_used(b);
+  trim(p, b, aligned_size);
+  return b;
+}
+
+// Takes a fit from any other arena that is not busy.
+static Block* steal(Arena* self, size_t aligned_size) {
+  for (int i = 0; i < NUM_ARENAS; i++) {
+    Arena* a = &arenas[i];
+    if (a == self || pthread_mutex_trylock(&a->lock) != 0)
+      continue;
+    drain_remote(a);
+    Block* b = take_block(&a->pool, aligned_size);
+    pthread_mutex_unlock(&a->lock);
+    if (b)
+      return b;
+  }
+  return NULL;
+}
+
+// Extends the heap by pad + size bytes, of which a owns the last size.
+// Returns the start of those.  A page the heap already reached keeps its
+// entry, which other threads read without a lock: it is a's already.
+static char* sbrk_for(Arena* a, size_t pad, size_t size) {
+  char *p = mem_sbrk(pad + size);
+  if (p == (void *)-1)
+    return NULL;
+  p += pad;
+  size_t first = page_of(p + ARENA_PAGE - 1);
+  size_t last = page_of(p + size - 1);
+  if (last >= first)
+    memset(&ChunkArena[first], a - arenas, last - first + 1);
+  return p;
+}
+
+// Returns the epilogue at the brk if a owns the last chunk, or NULL.
+static inline Block* top_of(Arena* a) {
+  char *brk = (char*)mem_heap_hi() + 1;
+  if (brk == chunk_base)
+    return NULL;
+  Block* end = (Block*)(brk - HEADER_SIZE);
+  return arena_of(end) == a ? end : NULL;
+}
+
+// Grows a's part of the heap and returns a used block of aligned_size
+// bytes from the growth.  The rest of it joins a's pool.
+static Block* grow(Arena* a, size_t aligned_size) {
+  Block* b;
+  pthread_mutex_lock(&grow_lock);
+  Block* end = top_of(a);
+  if (end) {
+    // Extend the last chunk, and its free top block if it has one.
+    size_t top_size = 0;
+    b = end;
+    if (!(end->size & PREV_USED)) {
+      top_size = *(size_t*)((char*)end - FOOTER_SIZE);
+      b = (Block*)((char*)end - top_size);
+    }
+    size_t size = aligned_size > top_size ? aligned_size - top_size : 0;
+    if (size && size < ARENA_GROW)
+      size = ARENA_GROW;
+    if (size && !sbrk_for(a, 0, size)) {
+      pthread_mutex_unlock(&grow_lock);
+      return NULL;
+    }
+    if (b != end)
+      remove_block(&a->pool, b);
+    b->size = (top_size + size) | (b->size & PREV_USED);
+  } else {
+    // Another arena's chunk ends at the brk, maybe mid-page.
+    size_t need = aligned_size + 2 * HEADER_SIZE;
+    size_t size = need < ARENA_GROW ? ARENA_GROW : need;
+    size_t pad = -(uintptr_t)((char*)mem_heap_hi() + 1) & (ARENA_PAGE - 1);
+    Block* prologue = (Block*)sbrk_for(a, pad, size);
+    if (!prologue) {
+      pthread_mutex_unlock(&grow_lock);
+      return NULL;
+    }
+    prologue->size = HEADER_SIZE | USED | PREV_USED;
+    b = next_block(prologue);
+    b->size = (size - 2 * HEADER_SIZE) | PREV_USED;
+  }
+  next_block(b)->size = USED;
+  pthread_mutex_unlock(&grow_lock);
+  mark_used(b);
+  trim(&a->pool, b, aligned_size);
+  return b;
+}
+
+// check - Walks every chunk checking the boundary tags and that all its
+// pages belong to one arena, then checks each arena's lists against the
+// free blocks of its chunks.
+int arena_check() {
+  size_t free_blocks[NUM_ARENAS] = {0};
+  char *hi = (char*)mem_heap_hi() + 1;
+  char *chunk = chunk_base;
+
+  while (chunk < hi) {
+    int a = ChunkArena[page_of(chunk)];
+    Block* end = (Block*)chunk;
+    // The epilogue is the first zero-sized block.
+    do {
+      end = next_block(end);
+    } while (SIZE(end->size) && (char*)end < hi);
+    char *next = (char*)end + HEADER_SIZE;
+    if (next > hi) {
+      printf("Chunk %p runs past the brk\n", chunk);
+      return -1;
+    }
+    if (check_blocks((Block*)chunk, end, &free_blocks[a]) < 0)
+      return -1;
+    for (char *p = chunk; p < next; p += ARENA_PAGE) {
+      if (ChunkArena[page_of(p)] != a) {
+        printf("Chunk %p spans arenas\n", chunk);
+        return -1;
+      }
+    }
+    // The next chunk starts on the following page.
+    if (next < hi)
+      next = chunk_base + (page_of(next - 1) + 1) * ARENA_PAGE;
+    chunk = next;
+  }
+
+  for (int a = 0; a < NUM_ARENAS; a++) {
+    if (check_pool(&arenas[a].pool, &free_blocks[a]) < 0)
+      return -1;
+    if (free_blocks[a]) {
+      printf("Free blocks in arena %d and in its lists disagree\n", a);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void init_locks() {
+  for (int a = 0; a < NUM_ARENAS; a++)
+    pthread_mutex_init(&arenas[a].lock, NULL);
+}
+
+// init - Empties every arena and aligns the heap for the first chunk.
+int arena_init() {
+  pthread_once(&arenas_once, init_locks);
+  for (int a = 0; a < NUM_ARENAS; a++) {
+    memset(&arenas[a].pool, 0, sizeof(arenas[a].pool));
+    arenas[a].remote = NULL;
+  }
+  char *brk = (char*)mem_heap_hi() + 1;
+  size_t pad = -(uintptr_t)brk & (ARENA_PAGE - 1);
+  if (pad && mem_sbrk(pad) == (void *)-1)
+    return -1;
+  chunk_base = brk + pad;
+  return 0;
+}
+
+// malloc - Serves the request from the thread's arena, then from an idle
+// arena, then from a new chunk.
+void * arena_malloc(size_t size) {
+  size_t aligned_size = request_size(size);
+  Arena* a = lock_arena();
+  drain_remote(a);
+  Block* b = take_block(&a->pool, aligned_size);
+  if (!b)
+    b = steal(a, aligned_size);
+  if (!b)
+    b = grow(a, aligned_size);
+  pthread_mutex_unlock(&a->lock);
+  return b ? (char*)b + HEADER_SIZE : NULL;
+}
+
+// free - Returns the block to the arena that owns its chunk: directly if
+// it is the thread's own arena, else through the arena's remote list.
+void arena_free(void *ptr) {
+  if (!ptr)
+    return;
+  Block* b = (Block*)((char*)ptr - HEADER_SIZE);
+  Arena* a = arena_of(b);
+  if (a - arenas != thread_arena) {
+    push_remote(a, b);
+    return;
+  }
+  pthread_mutex_lock(&a->lock);
+  free_block(&a->pool, b);
+  pthread_mutex_unlock(&a->lock);
+}
+
+// free_locked - Returns the block to its arena under the arena's lock,
+// whichever thread frees it.
+void arena_free_locked(void *ptr) {
+  if (!ptr)
+    return;
+  Block* b = (Block*)((char*)ptr - HEADER_SIZE);
+  Arena* a = arena_of(b);
+  pthread_mutex_lock(&a->lock);
+  free_block(&a->pool, b);
+  pthread_mutex_unlock(&a->lock);
+}
+
+// realloc - Shrinks in place, grows into a free right neighbour within the
+// owning arena or past the brk, and otherwise moves.
+void * arena_realloc(void *ptr, size_t size) {
+  if (!ptr)
+    return arena_malloc(size);
+
+  Block* b = (Block*)((char*)ptr - HEADER_SIZE);
+  size_t aligned_size = request_size(size);
+  Arena* a = arena_of(b);
+  void *newptr;
+
+  pthread_mutex_lock(&a->lock);
+  size_t old_size = SIZE(b->size);
+  if (aligned_size <= old_size) {
+    trim(&a->pool, b, aligned_size);
+    pthread_mutex_unlock(&a->lock);
+    return ptr;
+  }
+  Block* right = next_block(b);
+  if (!(right->size & USED) && old_size + SIZE(right->size) >= aligned_size) {
+    remove_block(&a->pool, right);
+    b->size += SIZE(right->size);
+    mark_used(b);
+    trim(&a->pool, b, aligned_size);
+    pthread_mutex_unlock(&a->lock);
+    return ptr;
+  }
+  // The last block of the heap, with the free block after it if any,
+  // grows past the brk.
+  pthread_mutex_lock(&grow_lock);
+  Block* end = right->size & USED ? right : next_block(right);
+  size_t have = old_size + (end == right ? 0 : SIZE(right->size));
+  size_t more = aligned_size - have;
+  if (end == top_of(a) && sbrk_for(a, 0, more)) {
+    if (end != right)
+      remove_block(&a->pool, right);
+    b->size += have - old_size + more;
+    next_block(b)->size = USED | PREV_USED;
+    pthread_mutex_unlock(&grow_lock);
+    trim(&a->pool, b, aligned_size);
+    pthread_mutex_unlock(&a->lock);
+    return ptr;
+  }
+  pthread_mutex_unlock(&grow_lock);
+  pthread_mutex_unlock(&a->lock);
+
+  newptr = arena_malloc(size);
+  if (NULL == newptr)
+    return NULL;
+  memcpy(newptr, ptr, old_size - HEADER_SIZE);
+  arena_free(ptr);
+  return newptr;
+}
+
+// memalign - Over-allocates, then frees the lead before the aligned
+// payload and trims the tail, under the lock of the block's arena.
+void * arena_memalign(size_t alignment, size_t size) {
+  size_t keep = request_size(size);
+  char *p = arena_malloc(keep + alignment + MIN_BLOCK_SIZE);
+  if (p == NULL)
+    return NULL;
+  Block* b = (Block*)(p - HEADER_SIZE);
+  Arena* a = arena_of(b);
+  pthread_mutex_lock(&a->lock);
+  b = align_block(&a->pool, b, alignment);
+  trim(&a->pool, b, keep);
+  pthread_mutex_unlock(&a->lock);
+  return (char*)b + HEADER_SIZE;
+}
+
+// usable_size - everything after the header belongs to the payload.
+size_t arena_usable_size(void *ptr) {
+  Block* b = (Block*)((char*)ptr - HEADER_SIZE);
+  return SIZE(__atomic_load_n(&b->size, __ATOMIC_RELAXED)) - HEADER_SIZE;
+}
+
+// call mem_reset_brk.
+void arena_reset_brk() {
+  mem_reset_brk();
+}
+
+// call mem_heap_lo
+void * arena_heap_lo() {
+  return mem_heap_lo();
+}
+
+// call mem_heap_hi
+void * arena_heap_hi() {
+  return mem_heap_hi();
+}
@@ -0,0 +1,207 @@
+// Copyright (c) 2012 MIT License by 6.172 Staff
+
+// binbench - measures the per-call cost of mapping a block size to its
+// FreeList bin.  The sizes replayed are the aligned block sizes that
+// range_alloc.h and pow2_alloc.h would compute for every malloc/realloc
+// in each trace.  Each allocator's old mapping is timed against
+// size_class.h.
+//
+// Usage: ./binbench [-t <dir>] [<tracefile> ...]
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./fcyc.h"
+#include "./size_class.h"
+#include "./trace_reader.h"
+
+// The size word range_alloc.h, and pow2_alloc.h in header mode, put in
+// front of every allocated block.
+#define BENCH_EXTRA_SIZE sizeof(size_t)
+// Number of fixed-size bins in pow2_alloc.h.
+#define BENCH_POW2_BINS 26
+#define BENCH_ALIGN(size) (((size) + 7) & ~(size_t)7)
+// Each sample replays the size stream this many times.
+#define BENCH_REPS 16
+
+typedef struct {
+  size_t *sizes;
+  size_t n;
+} sizes_t;
+
+// The accumulated bins are written here so the loops are not optimized out.
+static volatile size_t sink;
+
+// The bit hack range_alloc.h used before size_class.h: the upper bound of
+// lg(val) via five mask-and-shift steps on 32-bit constants.
+static size_t log_upper_legacy(size_t val) {
+  const unsigned int b[] = {0x2, 0xC, 0xF0, 0xFF00, 0xFFFF0000};
+  const unsigned int S[] = {1, 2, 4, 8, 16};
+  size_t r = 0;
+  val--;
+  for (int i = 4; i >= 0; i--) {
+    if (val & b[i]) {
+      val >>= S[i];
+      r |= S[i];
+    }
+  }
+  return r+1;
+}
+
+// The linear scan pow2_alloc.h used over its fixed_sizes[] table.
+static size_t pow2_scan_legacy(size_t aligned_size) {
+  static size_t fixed_sizes[BENCH_POW2_BINS];
+  if (!fixed_sizes[0])
+    for (int i = 0; i < BENCH_POW2_BINS; i++)
+      fixed_sizes[i] = ((size_t)1 << i) + BENCH_EXTRA_SIZE;
+  size_t index;
+  for (index = 0; index < BENCH_POW2_BINS; index++) {
+    if (fixed_sizes[index] >= aligned_size)
+      break;
+  }
+  return index;
+}
+
+// pow2_alloc.h's direct computation of the same bin.
+static inline size_t pow2_clz(size_t aligned_size) {
+  size_t bin = size_to_bin(aligned_size - BENCH_EXTRA_SIZE);
+  return bin < 3 ? 3 : bin;
+}
+
+static void run_legacy(void *argp) {
+  sizes_t *s = (sizes_t *)argp;
+  size_t acc = 0;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+    for (size_t i = 0; i < s->n; i++)
+      acc += log_upper_legacy(s->sizes[i]);
+  sink = acc;
+}
+
+static void run_size_to_bin(void *argp) {
+  sizes_t *s = (sizes_t *)argp;
+  size_t acc = 0;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+    for (size_t i = 0; i < s->n; i++)
+      acc += size_to_bin(s->sizes[i]);
+  sink = acc;
+}
+
+static void run_pow2_scan(void *argp) {
+  sizes_t *s = (sizes_t *)argp;
+  size_t acc = 0;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+    for (size_t i = 0; i < s->n; i++)
+      acc += pow2_scan_legacy(s->sizes[i]);
+  sink = acc;
+}
+
+static void run_pow2_clz(void *argp) {
+  sizes_t *s = (sizes_t *)argp;
+  size_t acc = 0;
+  for (int rep = 0; rep < BENCH_REPS; rep++)
+    for (size_t i = 0; i < s->n; i++)
+      acc += pow2_clz(s->sizes[i]);
+  sink = acc;
+}
+
+// Collects the block size of every request in the trace at path that
+// allocates.
+static int read_sizes(const char *path, sizes_t *s) {
+  FILE *f = fopen(path, "r");
+  trace_req_t req;
+  int header[4];
+
+  if (!f)
+    return -1;
+  if (fscanf(f, "%d %d %d %d", &header[0], &header[1],
+             &header[2], &header[3]) != 4) {
+    fclose(f);
+    return -1;
+  }
+  s->sizes = (size_t *)malloc(header[2] * sizeof(size_t));
+  s->n = 0;
+  while (read_request(f, &req) > 0) {
+    if (request_allocates(&req) && (int)s->n < header[2])
+      s->sizes[s->n++] = BENCH_ALIGN(request_bytes(&req) + BENCH_EXTRA_SIZE);
+  }
+  fclose(f);
+  return 0;
+}
+
+static void bench_trace(const char *path) {
+  sizes_t s;
+
+  if (read_sizes(path, &s) < 0 || s.n == 0) {
+    fprintf(stderr, "binbench: skipping %s\n", path);
+    return;
+  }
+
+  for (size_t i = 0; i < s.n; i++) {
+    size_t scan = pow2_scan_legacy(s.sizes[i]);
+    if (log_upper_legacy(s.sizes[i]) != size_to_bin(s.sizes[i]) ||
+        (scan < 3 ? 3 : scan) != pow2_clz(s.sizes[i])) {
+      printf("%s: mismatch at size %lu\n", path, s.sizes[i]);
+      exit(1);
+    }
+  }
+
+  double calls = (double)s.n * BENCH_REPS;
+  double legacy = fcyc(run_legacy, &s) / calls;
+  double fast = fcyc(run_size_to_bin, &s) / calls;
+  double scan = fcyc(run_pow2_scan, &s) / calls;
+  double clz = fcyc(run_pow2_clz, &s) / calls;
+  printf("%-36s%10lu%12.2f%12.2f%9.2fx%12.2f%12.2f%9.2fx\n",
+         path, s.n, legacy, fast, legacy / fast, scan, clz, scan / clz);
+  free(s.sizes);
+}
+
+int main(int argc, char **argv) {
+  char tracedir[1024] = "./traces/";
+  int c;
+
+  while ((c = getopt(argc, argv, "t:h")) != EOF) {
+    switch (c) {
+      case 't':
+        snprintf(tracedir, sizeof(tracedir), "%s/", optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: binbench [-t <dir>] [<tracefile> ...]\n");
+        exit(c == 'h' ? 0 : 1);
+    }
+  }
+
+  set_fcyc_k(3);
+  set_fcyc_maxsamples(20);
+  set_fcyc_epsilon(0.01);
+
+  printf("%-36s%10s%12s%12s%10s%12s%12s%10s\n",
+         "trace", "sizes", "log_upper", "size_to_bin", "speedup",
+         "pow2 scan", "pow2 clz", "speedup");
+  printf("%-36s%10s%12s%12s%10s%12s%12s\n", "", "", "(cyc/call)",
+         "(cyc/call)", "", "(cyc/call)", "(cyc/call)");
+
+  if (optind < argc) {
+    for (int i = optind; i < argc; i++)
+      bench_trace(argv[i]);
+    return 0;
+  }
+
+  DIR *dirp = opendir(tracedir);
+  if (!dirp) {
+    fprintf(stderr, "Cannot open directory '%s'\n", tracedir);
+    exit(EXIT_FAILURE);
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dirp))) {
+    char path[2048];
+    if (entry->d_name[0] == '.')
+      continue;
+    snprintf(path, sizeof(path), "%s%s", tracedir, entry->d_name);
+    bench_trace(path);
+  }
+  closedir(dirp);
+  return 0;
+}
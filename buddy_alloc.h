@@ -0,0 +1,407 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "./allocator_interface.h"
+#include "./config.h"
+#include "./memlib.h"
+#include "./size_class.h"
+
+// Don't call libc malloc!
+#define malloc(...) (USE_MY_MALLOC)
+#define free(...) (USE_MY_FREE)
+#define realloc(...) (USE_MY_REALLOC)
+
+// A binary buddy allocator.  Every block holds 2^k bytes for some order k
+// and starts at an offset from buddy_base that is a multiple of 2^k, so
+// the buddy of a block is found by flipping bit k of its offset.  A miss
+// splits the smallest larger free block, and free merges a block with its
+// buddy for as long as the buddy is free and whole.
+
+// All blocks must have a specified minimum alignment.
+// The alignment requirement (from config.h) is >= 8 bytes.
+#ifndef ALIGNMENT
+#define ALIGNMENT 8
+#endif
+
+// Rounds up to the nearest multiple of ALIGNMENT.
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
+
+// The smallest aligned size that will hold a size_t value.
+#define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
+
+// Allocated blocks start with a size_t holding their order.
+#define HEADER_SIZE SIZE_T_SIZE
+
+// A free block must hold its list Node.
+#define MIN_ORDER 4
+
+// 2^26 > 50 MB which is max size of alloc request.
+#define MAX_ORDER 26
+#define NUM_ORDERS (MAX_ORDER + 1)
+
+#define ORDER_SIZE(k) ((size_t)1 << (k))
+
+typedef struct Node {
+  struct Node *next;
+  struct Node *prev;
+} Node;
+
+_Static_assert(sizeof(Node) <= ORDER_SIZE(MIN_ORDER),
+               "MIN_ORDER blocks must hold a free list Node");
+
+// FreeList[k] holds the free blocks of order k.  Bit k of OrderMap is set
+// iff FreeList[k] is non-empty.
+static Node* FreeList[NUM_ORDERS];
+static uint64_t OrderMap;
+
+// One bit per possible block of each order: bit (off >> k) of order k's
+// map is set iff a free block of order k starts at offset off.  Free
+// blocks carry no header, so these maps are the only record of their
+// order.
+#define ORDER_WORDS(k) ((MAX_HEAP >> (k)) / 64 + 1)
+#define FREE_MAP_WORDS ((MAX_HEAP >> (MIN_ORDER - 1)) / 64 + NUM_ORDERS)
+static uint64_t FreeMap[FREE_MAP_WORDS];
+// Start of order k's map within FreeMap.
+static uint64_t* FreeBits[NUM_ORDERS];
+
+// The first block of the heap, and the offset of the brk from it.
+static char* buddy_base;
+static size_t buddy_top;
+
+static inline size_t offset_of(void* p) {
+  return (char*)p - buddy_base;
+}
+
+static inline int is_free(size_t off, int k) {
+  size_t bit = off >> k;
+  return (FreeBits[k][bit / 64] >> (bit % 64)) & 1;
+}
+
+static inline void set_free(size_t off, int k, int free) {
+  size_t bit = off >> k;
+  if (free)
+    FreeBits[k][bit / 64] |= (uint64_t)1 << (bit % 64);
+  else
+    FreeBits[k][bit / 64] &= ~((uint64_t)1 << (bit % 64));
+}
+
+// Returns the order of the smallest block that holds size bytes plus a
+// header.
+static inline int order_of(size_t size) {
+  size_t k = size_to_bin(size + HEADER_SIZE);
+  return k < MIN_ORDER ? MIN_ORDER : k;
+}
+
+static inline void push_block(size_t off, int k) {
+  Node *n = (Node*)(buddy_base + off);
+  n->prev = NULL;
+  n->next = FreeList[k];
+  if (n->next)
+    n->next->prev = n;
+  FreeList[k] = n;
+  OrderMap |= (uint64_t)1 << k;
+  set_free(off, k, 1);
+}
+
+static inline void remove_block(size_t off, int k) {
+  Node *n = (Node*)(buddy_base + off);
+  if (n->prev)
+    n->prev->next = n->next;
+  else
+    FreeList[k] = n->next;
+  if (n->next)
+    n->next->prev = n->prev;
+  if (!FreeList[k])
+    OrderMap &= ~((uint64_t)1 << k);
+  set_free(off, k, 0);
+}
+
+// Frees the block of order k at off, merging it with its buddy for as long
+// as the buddy is a whole free block.
+static void free_block(size_t off, int k) {
+  while (k < MAX_ORDER) {
+    size_t buddy = off ^ ORDER_SIZE(k);
+    if (buddy + ORDER_SIZE(k) > buddy_top || !is_free(buddy, k))
+      break;
+    remove_block(buddy, k);
+    off &= ~ORDER_SIZE(k);
+    k++;
+  }
+  push_block(off, k);
+}
+
+// Splits the block of order k at off down to order want, freeing the upper
+// halves.
+static inline void split_block(size_t off, int k, int want) {
+  while (k > want) {
+    k--;
+    push_block(off + ORDER_SIZE(k), k);
+  }
+}
+
+static inline void * finish(size_t off, int k) {
+  char *b = buddy_base + off;
+  *(size_t*)b = k;
+  return b + HEADER_SIZE;
+}
+
+// check - Walks the heap block by block and the free lists node by node,
+// and checks that they agree with the free maps.
+int my_check() {
+  size_t off = 0;
+  size_t free_blocks = 0;
+
+  while (off < buddy_top) {
+    int k;
+    for (k = MIN_ORDER; k <= MAX_ORDER; k++) {
+      if (!(off & (ORDER_SIZE(k) - 1)) && is_free(off, k))
+        break;
+    }
+    if (k <= MAX_ORDER) {
+      size_t buddy = off ^ ORDER_SIZE(k);
+      if (buddy + ORDER_SIZE(k) <= buddy_top && is_free(buddy, k)) {
+        printf("Free buddies at %lu and %lu were not merged\n", off, buddy);
+        return -1;
+      }
+      free_blocks++;
+    } else {
+      k = *(size_t*)(buddy_base + off);
+      if (k < MIN_ORDER || k > MAX_ORDER || (off & (ORDER_SIZE(k) - 1))) {
+        printf("Block at %lu has bad order %d\n", off, k);
+        return -1;
+      }
+    }
+    off += ORDER_SIZE(k);
+  }
+  if (off != buddy_top) {
+    printf("Blocks did not end at heap_hi!\n");
+    return -1;
+  }
+
+  for (int k = 0; k < NUM_ORDERS; k++) {
+    if (!FreeList[k] != !(OrderMap & ((uint64_t)1 << k))) {
+      printf("OrderMap disagrees with FreeList[%d]\n", k);
+      return -1;
+    }
+    for (Node *n = FreeList[k]; n; n = n->next) {
+      off = offset_of(n);
+      if (off >= buddy_top || !is_free(off, k) ||
+          (n->next && n->next->prev != n)) {
+        printf("FreeList[%d] had a bad node %p\n", k, n);
+        return -1;
+      }
+      free_blocks--;
+    }
+  }
+  if (free_blocks) {
+    printf("Free maps and free lists disagree\n");
+    return -1;
+  }
+  return 0;
+}
+
+// init - Clears the free lists and the part of the free maps the last run
+// touched, and aligns the first block.
+int my_init() {
+  uint64_t *bits = FreeMap;
+  for (int k = 0; k < NUM_ORDERS; k++) {
+    FreeList[k] = NULL;
+    FreeBits[k] = bits;
+    if (k >= MIN_ORDER) {
+      memset(bits, 0, ((buddy_top >> k) / 64 + 1) * sizeof(uint64_t));
+      bits += ORDER_WORDS(k);
+    }
+  }
+  OrderMap = 0;
+
+  char *brk = (char*)mem_heap_hi() + 1;
+  size_t pad = -(uintptr_t)brk & (ORDER_SIZE(MIN_ORDER) - 1);
+  if (pad && mem_sbrk(pad) == (void *)-1)
+    return -1;
+  buddy_base = brk + pad;
+  buddy_top = 0;
+  return 0;
+}
+
+// Returns the order of the largest block that can start at off and end at
+// or before the brk.
+static inline int largest_order(size_t off) {
+  int j = off ? __builtin_ctzl(off) : MAX_ORDER;
+  while (off + ORDER_SIZE(j) > buddy_top)
+    j--;
+  return j;
+}
+
+// Extends the heap so that a block of order k ends at the brk and returns
+// its offset, or -1.  The block reuses the free tail of the heap when the
+// tail starts at a multiple of 2^k.  Otherwise it starts at the next such
+// multiple and the gap is freed.
+static size_t grow(int k) {
+  size_t start = buddy_top & ~(ORDER_SIZE(k) - 1);
+  size_t off;
+  int j;
+
+  // Once merged, a free tail is the run of largest blocks that fit.
+  for (off = start; off < buddy_top; off += ORDER_SIZE(j)) {
+    j = largest_order(off);
+    if (!is_free(off, j))
+      break;
+  }
+  int reuse = off >= buddy_top;
+  if (!reuse)
+    start += ORDER_SIZE(k);
+
+  size_t end = start + ORDER_SIZE(k);
+  if (end > MAX_HEAP || mem_sbrk(end - buddy_top) == (void *)-1)
+    return (size_t)-1;
+
+  if (reuse) {
+    for (off = start; off < buddy_top; off += ORDER_SIZE(j)) {
+      j = largest_order(off);
+      remove_block(off, j);
+    }
+    buddy_top = end;
+    return start;
+  }
+
+  // The gap splits into naturally aligned blocks of increasing order.
+  off = buddy_top;
+  buddy_top = end;
+  while (off < start) {
+    j = __builtin_ctzl(off);
+    free_block(off, j);
+    off += ORDER_SIZE(j);
+  }
+  return start;
+}
+
+//  malloc - Takes the smallest free block of at least the request's order
+//  and splits it down, growing the heap when no block is large enough.
+void * my_malloc(size_t size) {
+  assert (my_check() == 0);
+  int k = order_of(size);
+  size_t off;
+
+  if (k > MAX_ORDER)
+    return NULL;
+
+  uint64_t avail = OrderMap & ~(ORDER_SIZE(k) - 1);
+  if (avail) {
+    int j = __builtin_ctzl(avail);
+    off = offset_of(FreeList[j]);
+    remove_block(off, j);
+    split_block(off, j, k);
+  } else {
+    off = grow(k);
+    if (off == (size_t)-1)
+      return NULL;
+  }
+  return finish(off, k);
+}
+
+// free - returns the block to its order and merges it with its buddies.
+void my_free(void *ptr) {
+  char *b = (char*)ptr - HEADER_SIZE;
+  free_block(offset_of(b), *(size_t*)b);
+}
+
+// realloc - Shrinks by splitting off upper halves.  Grows in place when
+// every buddy above the block up to the new order is free, or lies past
+// the brk.  Otherwise moves the data to a new block.
+void * my_realloc(void *ptr, size_t size) {
+  if (!ptr)
+    return my_malloc(size);
+
+  char *b = (char*)ptr - HEADER_SIZE;
+  size_t off = offset_of(b);
+  int k = *(size_t*)b;
+  int want = order_of(size);
+  void *newptr;
+
+  if (want <= k) {
+    split_block(off, k, want);
+    return finish(off, want);
+  }
+
+  // The block can only absorb buddies above it, i.e. while it is the lower
+  // half at each order.
+  int j;
+  for (j = k; j < want && j < MAX_ORDER; j++) {
+    size_t buddy = off + ORDER_SIZE(j);
+    if ((off & ORDER_SIZE(j)) ||
+        (buddy < buddy_top && !is_free(buddy, j)))
+      break;
+  }
+  size_t end = off + ORDER_SIZE(want);
+  if (j == want && end <= MAX_HEAP) {
+    if (end > buddy_top) {
+      if (mem_sbrk(end - buddy_top) == (void *)-1)
+        return NULL;
+      buddy_top = end;
+    }
+    for (j = k; j < want; j++) {
+      size_t buddy = off + ORDER_SIZE(j);
+      if (is_free(buddy, j))
+        remove_block(buddy, j);
+    }
+    return finish(off, want);
+  }
+
+  // Allocate a new chunk of memory, and fail if that allocation fails.
+  newptr = my_malloc(size);
+  if (NULL == newptr)
+    return NULL;
+
+  // The new block is larger, so the whole old payload is copied.
+  memcpy(newptr, ptr, ORDER_SIZE(k) - HEADER_SIZE);
+
+  // Release the old block.
+  my_free(ptr);
+
+  // Return a pointer to the new block.
+  return newptr;
+}
+
+// usable_size - the block of the order in the header, less the header.
+size_t my_usable_size(void *ptr) {
+  return ORDER_SIZE(*(size_t*)((char*)ptr - HEADER_SIZE)) - HEADER_SIZE;
+}
+
+// call mem_reset_brk.
+void my_reset_brk() {
+  mem_reset_brk();
+}
+
+// call mem_heap_lo
+void * my_heap_lo() {
+  return mem_heap_lo();
+}
+
+// call mem_heap_hi
+void * my_heap_hi() {
+  return mem_heap_hi();
+}
@@ -41,3 +41,16 @@ void * libc_realloc(void *ptr, size_t size) {
 void libc_free(void *ptr) {
   free(ptr);
 }
+
+/* call posix_memalign, which wants at least pointer alignment */
+void * libc_memalign(size_t alignment, size_t size) {
+  void *p;
+  if (alignment < sizeof(void *))
+    return malloc(size);
+  return posix_memalign(&p, alignment, size) ? NULL : p;
+}
+
+/* call default calloc */
+void * libc_calloc(size_t nmemb, size_t size) {
+  return calloc(nmemb, size);
+}
@@ -10,9 +10,23 @@
  * May not be used, modified, or copied without permission.
  */
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
 #include "./mdriver.h"
+#include "./clock.h"
+#include "./trace_reader.h"
 #include "./validator.h"
 
+/* Set when the allocator was built with THREAD_SAFE=1, which -T needs */
+#ifndef THREAD_SAFE
+#define THREAD_SAFE 0
+#endif
+
 /******************************
  * Private compound data types
  *****************************/
@@ -27,15 +41,66 @@ typedef struct {
 
   /* defined only for the student malloc package */
   double util;     /* space utilization for this trace (always 0 for libc) */
+  double max_cycles; /* slowest single malloc/free/realloc (set by -s) */
 
   /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+/* One multithreaded replay.  Each of num_threads threads replays its own
+   copy of the trace, recording its blocks in its row of blocks, unless
+   the trace has thread ids.  Then thread i replays the ops of the trace's
+   threads i, i + num_threads, ..., all in row 0, and waits before each op
+   for the ops before it on the same block. */
+typedef struct {
+  const malloc_impl_t *impl;
+  trace_t *trace;
+  int num_threads;
+  char ***blocks;
+  int *seq;        /* ops on the same block before each op (thread ids) */
+  int *done;       /* ops replayed on each block so far (thread ids) */
+  double *thread_ops;  /* ops each thread replayed in the last run */
+  double *thread_secs; /* ... and the seconds it took */
+  pthread_barrier_t start;
+  size_t heap;     /* heap bytes after the last run (set by -M) */
+} threads_t;
+
+/* Arguments for one replay thread */
+typedef struct {
+  threads_t *run;
+  int id;
+} thread_arg_t;
+
+/* Blocks in flight from one producer thread to the consumer that frees
+   them: a single-producer single-consumer ring */
+#define RING_SLOTS 256
+typedef struct {
+  char *slots[RING_SLOTS];
+  size_t head;   /* slots filled by the producer */
+  size_t tail;   /* slots emptied by the consumer */
+} ring_t;
+
+/* One producer/consumer run: each of num_pairs producers mallocs the
+   trace's allocation sizes and hands the blocks to its own consumer */
+typedef struct {
+  const malloc_impl_t *impl;
+  trace_t *trace;
+  int num_pairs;
+  ring_t *rings;
+  pthread_barrier_t start;
+} pairs_t;
+
+/* Arguments for one producer or consumer thread */
+typedef struct {
+  pairs_t *run;
+  int id;
+} pair_arg_t;
+
 /********************
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static int replay_gaps = 0; /* -T waits out the trace's op gaps (set by -G) */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -43,12 +108,18 @@ static char tracedir[MAXLINE] = TRACEDIR;
 
 static const char xor_constant = 0x7B;
 
+/* Each op's latency is the fastest of this many replays, which filters
+   out interrupts but keeps slow paths that recur on every replay */
+#define LATENCY_RUNS 3
+
 /*********************
  * Function prototypes
  *********************/
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static trace_t *map_trace(char *path);
+static void write_trace(char *dir, char *filename, trace_t *trace);
 static void free_trace(trace_t *trace);
 
 /* Routines for evaluating correctnes, space utilization, and speed
@@ -61,10 +132,26 @@ static void eval_my_speed(trace_t *trace) {
 static void eval_libc_speed(trace_t *trace) {
   eval_mm_speed(&libc_impl, trace);
 }
+static void eval_tlsf_speed(trace_t *trace) {
+  eval_mm_speed(&tlsf_impl, trace);
+}
+static void replay_trace(const malloc_impl_t *impl, trace_t *trace,
+                         char **blocks);
+static void eval_mm_threads(threads_t *run);
+static double eval_mm_aggregate(threads_t *run, const malloc_impl_t *impl,
+                                double *per_thread);
+static void eval_mm_scaling(trace_t *trace, char *tracefile, int max_threads);
+static void eval_mm_crowd(threads_t *run);
+static void eval_mm_crowds(trace_t *trace, char *tracefile, int num_threads);
+static void eval_mm_pairs(pairs_t *run);
+static void eval_mm_frees(trace_t *trace, char *tracefile, int num_pairs);
+static double eval_mm_latency(const malloc_impl_t *impl, trace_t *trace);
 static int eval_mm_check(const malloc_impl_t *impl, trace_t *trace, int tracenum);
 
 /* Various helper routines */
 static void printresults(int n, char **tracefiles, stats_t *stats);
+static void printcompare(int n, char **tracefiles, stats_t *mm_stats,
+                         stats_t *tlsf_stats);
 static void usage(void);
 
 /**************
@@ -79,10 +166,16 @@ int main(int argc, char **argv) {
   stats_t *libc_stats = NULL;/* libc stats for each trace */
   stats_t *bad_stats = NULL; /* bad malloc stats for each trace */
   stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+  stats_t *tlsf_stats = NULL;/* TLSF malloc stats for each trace */
 
   int run_bad = 0;     /* If set, run bad malloc (set by -b) */
   int check_heap = 0;  /* If set, run the student heap checker (set by -c) */
   int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+  int run_tlsf = 0;    /* If set, compare against TLSF malloc (set by -s) */
+  int max_threads = 0; /* If set, replay on 1..max_threads threads (-T) */
+  int num_pairs = 0;   /* If set, run producer/consumer pairs (-P) */
+  int crowd = 0;       /* If set, run this many threads at once (-M) */
+  char *bindir = NULL; /* If set, write binary traces here and exit (-B) */
 
   /* temporaries used to compute the performance index */
   double total_throughput, total_util, average_util, average_throughput, p1, p2, perfindex;
@@ -91,7 +184,7 @@ int main(int argc, char **argv) {
   /*
    * Read and interpret the command line arguments
    */
-  while ((c = getopt(argc, argv, "f:t:hvVgalbc")) != EOF) {
+  while ((c = getopt(argc, argv, "f:t:T:P:M:B:GhvVgalbcs")) != EOF) {
     switch (c) {
       case 'g': /* Generate summary info for the autograder */
         autograder = 1;
@@ -117,6 +210,44 @@ int main(int argc, char **argv) {
       case 'c':
         check_heap = 1;
         break;
+      case 's': /* Compare against TLSF malloc, with worst-case latency */
+        run_tlsf = 1;
+        break;
+      case 'T': /* Measure scaling on up to this many threads */
+        max_threads = atoi(optarg);
+        if (max_threads < 1) {
+          usage();
+          exit(1);
+        }
+        if (!THREAD_SAFE) {
+          fprintf(stderr, "-T needs an allocator built with THREAD_SAFE=1\n");
+          exit(1);
+        }
+        break;
+      case 'G': /* Replay -T traces with their recorded gaps */
+        replay_gaps = 1;
+        break;
+      case 'P': /* Free blocks on other threads than allocated them */
+        num_pairs = atoi(optarg);
+        if (num_pairs < 1) {
+          usage();
+          exit(1);
+        }
+        break;
+      case 'M': /* Churn small blocks on many more threads than cores */
+        crowd = atoi(optarg);
+        if (crowd < 1) {
+          usage();
+          exit(1);
+        }
+        if (!THREAD_SAFE) {
+          fprintf(stderr, "-M needs an allocator built with THREAD_SAFE=1\n");
+          exit(1);
+        }
+        break;
+      case 'B': /* Convert the traces to binary ones in this directory */
+        bindir = optarg;
+        break;
       case 'v': /* Print per-trace performance breakdown */
         verbose = 1;
         break;
@@ -167,6 +298,16 @@ int main(int argc, char **argv) {
     }
   }
 
+  /* Write each trace out in binary, under the same name, and stop */
+  if (bindir) {
+    for (i = 0; i < num_tracefiles; i++) {
+      trace = read_trace(tracedir, tracefiles[i]);
+      write_trace(bindir, tracefiles[i], trace);
+      free_trace(trace);
+    }
+    exit(0);
+  }
+
   /* Initialize the timing package */
   init_fsecs();
 
@@ -275,10 +416,108 @@ int main(int argc, char **argv) {
         printf("and performance.\n");
       }
       mm_stats[i].secs = fsecs((void (*)(void *))eval_my_speed, trace);
+      if (run_tlsf)
+        mm_stats[i].max_cycles = eval_mm_latency(&my_impl, trace);
     }
     free_trace(trace);
   }
 
+  /*
+   * Optionally run and evaluate the TLSF package
+   */
+  if (run_tlsf) {
+    if (verbose > 1) {
+      printf("\nTesting tlsf malloc\n");
+    }
+
+    /* Allocate tlsf stats array, with one stats_t struct per tracefile */
+    tlsf_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+    if (tlsf_stats == NULL) {
+      unix_error("tlsf_stats calloc in main failed");
+    }
+
+    /* Evaluate the TLSF malloc package using the K-best scheme */
+    for (i = 0; i < num_tracefiles; i++) {
+      trace = read_trace(tracedir, tracefiles[i]);
+      tlsf_stats[i].ops = trace->num_ops;
+      if (verbose > 1) {
+        printf("Checking tlsf malloc for correctness, ");
+      }
+      tlsf_stats[i].valid = eval_mm_valid(&tlsf_impl, trace, i);
+      if (check_heap) {
+        tlsf_stats[i].checked = eval_mm_check(&tlsf_impl, trace, i);
+      }
+      if (tlsf_stats[i].valid) {
+        if (verbose > 1) {
+          printf("efficiency, ");
+        }
+        tlsf_stats[i].util = eval_mm_util(&tlsf_impl, trace, i);
+        if (verbose > 1) {
+          printf("and performance.\n");
+        }
+        tlsf_stats[i].secs = fsecs((void (*)(void *))eval_tlsf_speed, trace);
+        tlsf_stats[i].max_cycles = eval_mm_latency(&tlsf_impl, trace);
+      }
+      free_trace(trace);
+    }
+
+    /* Display the tlsf results in a compact table */
+    if (verbose) {
+      printf("\nResults for tlsf malloc:\n");
+      printresults(num_tracefiles, tracefiles, tlsf_stats);
+    }
+    printf("\nmm malloc vs. tlsf malloc:\n");
+    printcompare(num_tracefiles, tracefiles, mm_stats, tlsf_stats);
+  }
+
+  /*
+   * Optionally measure how the mm package scales with threads
+   */
+  if (max_threads) {
+    printf("\nmm malloc scaling (Kops/sec):\n");
+    printf("%30s%8s%10s%11s%10s%9s%9s\n", "filename", "threads",
+           "mm", "per-thread", "libc", "vs libc", "speedup");
+    for (i = 0; i < num_tracefiles; i++) {
+      if (!mm_stats[i].valid)
+        continue;
+      trace = read_trace(tracedir, tracefiles[i]);
+      eval_mm_scaling(trace, tracefiles[i], max_threads);
+      free_trace(trace);
+    }
+  }
+
+  /*
+   * Optionally measure the small-block caches with many threads per core
+   */
+  if (crowd) {
+    printf("\nmm malloc on %d threads, caching %s:\n", crowd,
+           my_percpu_cache() ? "per CPU" : "per thread");
+    printf("%30s%10s%10s%10s\n", "filename", "libc", "mm", "heap KB");
+    for (i = 0; i < num_tracefiles; i++) {
+      if (!mm_stats[i].valid)
+        continue;
+      trace = read_trace(tracedir, tracefiles[i]);
+      eval_mm_crowds(trace, tracefiles[i], crowd);
+      free_trace(trace);
+    }
+  }
+
+  /*
+   * Optionally measure frees from other threads, with the arenas' remote
+   * free lists against their locks
+   */
+  if (num_pairs) {
+    printf("\nremote frees with %d producer/consumer pairs (Kops/sec):\n",
+           num_pairs);
+    printf("%30s%10s%10s%10s%9s\n",
+           "filename", "libc", "locked", "remote", "speedup");
+    for (i = 0; i < num_tracefiles; i++) {
+      trace = read_trace(tracedir, tracefiles[i]);
+      eval_mm_frees(trace, tracefiles[i], num_pairs);
+      free_trace(trace);
+    }
+  }
+
   /* Free the simulated heap block. */
   mem_deinit();
 
@@ -345,6 +584,7 @@ int main(int argc, char **argv) {
   free(libc_stats);
   free(bad_stats);
   free(mm_stats);
+  free(tlsf_stats);
 
   for (i = 0; i < num_tracefiles; i++) {
     free(tracefiles[i]);
@@ -364,24 +604,31 @@ int main(int argc, char **argv) {
 static trace_t *read_trace(char *tracedir, char *filename) {
   FILE *tracefile;
   trace_t *trace;
-  char type[MAXLINE];
+  traceop_t *op;
+  trace_req_t req;
   char path[MAXLINE];
-  unsigned index, size;
   unsigned max_index = 0;
   unsigned op_index;
+  int rc;
 
   if (verbose > 1) {
     printf("Reading tracefile: %s\n", filename);
   }
 
+  strcpy(path, tracedir);
+  strcat(path, filename);
+
+  /* A binary trace is decoded from its packed records */
+  if ((trace = map_trace(path)) != NULL) {
+    return trace;
+  }
+
   /* Allocate the trace record */
   if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL) {
     unix_error("malloc 1 failed in read_trance");
   }
 
   /* Read the trace file header */
-  strcpy(path, tracedir);
-  strcat(path, filename);
   if ((tracefile = fopen(path, "r")) == NULL) {
     sprintf(msg, "Could not open %s in read_trace", path);
     unix_error(msg);
@@ -390,6 +637,7 @@ static trace_t *read_trace(char *tracedir, char *filename) {
   fscanf(tracefile, "%d", &(trace->num_ids));
   fscanf(tracefile, "%d", &(trace->num_ops));
   fscanf(tracefile, "%d", &(trace->weight));        /* not used */
+  trace->num_threads = 0;
 
   /* We'll store each request line in the trace in this array */
   if ((trace->ops =
@@ -410,42 +658,62 @@ static trace_t *read_trace(char *tracedir, char *filename) {
   }
 
   /* read every request line in the trace file */
-  index = 0;
   op_index = 0;
-  while (fscanf(tracefile, "%s", type) != EOF) {
-    switch(type[0]) {
+  while ((rc = read_request(tracefile, &req)) != 0) {
+    if (rc < 0) {
+      printf("Bogus type character (%c) in tracefile %s\n",
+             req.type, path);
+      exit(1);
+    }
+    /* Requests without a thread id are thread 0 */
+    if (req.thread < 0) {
+      printf("Bogus thread id (%d) in tracefile %s\n", req.thread, path);
+      exit(1);
+    }
+    if (req.has_thread && req.thread >= trace->num_threads)
+      trace->num_threads = req.thread + 1;
+    op = &trace->ops[op_index];
+    op->index = req.index;
+    op->size = req.size;
+    op->nmemb = 0;
+    op->thread = req.thread;
+    op->align = 0;
+    op->gap = req.gap;
+    switch(req.type) {
       case 'a':
-        fscanf(tracefile, "%u %u", &index, &size);
-        trace->ops[op_index].type = ALLOC;
-        trace->ops[op_index].index = index;
-        trace->ops[op_index].size = size;
-        max_index = (index > max_index) ? index : max_index;
+        op->type = ALLOC;
         break;
       case 'r':
-        fscanf(tracefile, "%u %u", &index, &size);
-        trace->ops[op_index].type = REALLOC;
-        trace->ops[op_index].index = index;
-        trace->ops[op_index].size = size;
-        max_index = (index > max_index) ? index : max_index;
+        op->type = REALLOC;
         break;
       case 'f':
-        fscanf(tracefile, "%ud", &index);
-        trace->ops[op_index].type = FREE;
-        trace->ops[op_index].index = index;
+        op->type = FREE;
         break;
       case 'w':
-        fscanf(tracefile, "%u %u", &index, &size);
-        trace->ops[op_index].type = WRITE;
-        trace->ops[op_index].index = index;
-        trace->ops[op_index].size = size;
+        op->type = WRITE;
+        break;
+      case 'c':
+        if (req.nmemb && req.size > INT_MAX / req.nmemb) {
+          printf("Bogus calloc size (%u * %u) in tracefile %s\n",
+                 req.nmemb, req.size, path);
+          exit(1);
+        }
+        op->type = CALLOC;
+        op->nmemb = req.nmemb;
+        op->size = req.nmemb * req.size;
+        break;
+      case 'm':
+        if (req.align == 0 || (req.align & (req.align - 1))) {
+          printf("Bogus alignment (%u) in tracefile %s\n", req.align, path);
+          exit(1);
+        }
+        op->type = MEMALIGN;
+        op->align = req.align;
         break;
-      default:
-        printf("Bogus type character (%c) in tracefile %s\n",
-               type[0], path);
-        exit(1);
     }
+    if (request_allocates(&req) && req.index > max_index)
+      max_index = req.index;
     op_index++;
-
   }
   fclose(tracefile);
   assert((int) max_index == trace->num_ids - 1);
@@ -454,9 +722,200 @@ static trace_t *read_trace(char *tracedir, char *filename) {
   return trace;
 }
 
+/*
+ * get_varint - decode the varint at *p, which must end before end, into
+ *   *v and move *p past it.  Returns 0 if it runs past end or past 32 bits.
+ */
+static int get_varint(const unsigned char **p, const unsigned char *end,
+                      uint32_t *v) {
+  uint64_t x = 0;
+  int shift = 0;
+
+  do {
+    if (*p == end || shift > 28)
+      return 0;
+    x |= (uint64_t)(**p & 0x7f) << shift;
+    shift += 7;
+  } while (*(*p)++ & 0x80);
+  if (x > UINT32_MAX)
+    return 0;
+  *v = x;
+  return 1;
+}
+
+/*
+ * map_trace - map a binary trace file written by write_trace and decode
+ *   its packed records into ops.  Returns NULL if the file is not a
+ *   binary trace.
+ */
+static trace_t *map_trace(char *path) {
+  tracehdr_t hdr;
+  struct stat st;
+  trace_t *trace;
+  const unsigned char *p, *end;
+  void *map;
+  int fd, i;
+
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    return NULL;              /* read_trace reports it */
+  }
+  if (fstat(fd, &st) < 0) {
+    unix_error("fstat failed in map_trace");
+  }
+  if ((size_t)st.st_size < sizeof(hdr) ||
+      pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+      memcmp(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+    close(fd);
+    return NULL;
+  }
+  if (hdr.version != TRACE_VERSION) {
+    printf("Binary tracefile %s has version %u, not %d; convert it again\n",
+           path, hdr.version, TRACE_VERSION);
+    exit(1);
+  }
+  if (hdr.num_ops < 0 || hdr.num_ids < 0 || hdr.num_threads < 0) {
+    printf("Binary tracefile %s has a bad header\n", path);
+    exit(1);
+  }
+
+  if (verbose > 1) {
+    printf("Mapping tracefile: %s\n", path);
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    unix_error("mmap failed in map_trace");
+  }
+  close(fd);
+
+  if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL) {
+    unix_error("malloc 1 failed in map_trace");
+  }
+  trace->sugg_heapsize = hdr.sugg_heapsize;
+  trace->num_ids = hdr.num_ids;
+  trace->num_ops = hdr.num_ops;
+  trace->weight = hdr.weight;
+  trace->num_threads = hdr.num_threads;
+
+  if ((trace->ops =
+       (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL) {
+    unix_error("malloc 2 failed in map_trace");
+  }
+  if ((trace->blocks =
+       (char **)malloc(trace->num_ids * sizeof(char *))) == NULL) {
+    unix_error("malloc 3 failed in map_trace");
+  }
+  if ((trace->block_sizes =
+       (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL) {
+    unix_error("malloc 4 failed in map_trace");
+  }
+
+  p = (const unsigned char *)map + sizeof(hdr);
+  end = (const unsigned char *)map + st.st_size;
+  for (i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = &trace->ops[i];
+    uint32_t index, size = 0, nmemb = 0, align = 0, thread = 0, gap = 0;
+    int flags, ok;
+
+    if (p == end)
+      break;
+    flags = *p++;
+    op->type = flags & TRACEREC_TYPE;
+    ok = op->type <= MEMALIGN && get_varint(&p, end, &index) &&
+         (op->type == FREE || get_varint(&p, end, &size)) &&
+         (op->type != CALLOC || get_varint(&p, end, &nmemb)) &&
+         (op->type != MEMALIGN || get_varint(&p, end, &align)) &&
+         (!(flags & TRACEREC_THREAD) || get_varint(&p, end, &thread)) &&
+         (!(flags & TRACEREC_GAP) || get_varint(&p, end, &gap));
+    if (!ok || index >= (uint32_t)trace->num_ids || size > INT_MAX ||
+        nmemb > INT_MAX || align > INT_MAX ||
+        thread >= (uint32_t)(trace->num_threads ? trace->num_threads : 1))
+      break;
+    op->index = index;
+    op->size = size;
+    op->nmemb = nmemb;
+    op->align = align;
+    op->thread = thread;
+    op->gap = gap;
+  }
+  if (i != trace->num_ops || p != end) {
+    printf("Binary tracefile %s is corrupt at request %d\n", path, i);
+    exit(1);
+  }
+  munmap(map, st.st_size);
+  return trace;
+}
+
+/*
+ * put_varint - append v to f as a varint.
+ */
+static void put_varint(FILE *f, uint32_t v) {
+  while (v >= 0x80) {
+    putc((v & 0x7f) | 0x80, f);
+    v >>= 7;
+  }
+  putc(v, f);
+}
+
+/*
+ * write_trace - write a trace as a binary trace file in dir, named as
+ *   the last component of filename, for map_trace to load.
+ */
+static void write_trace(char *dir, char *filename, trace_t *trace) {
+  FILE *binfile;
+  tracehdr_t hdr;
+  char path[MAXLINE - 64]; /* short enough to quote in msg */
+  char *name = strrchr(filename, '/');
+  int i;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name ? name + 1 : filename);
+  if ((binfile = fopen(path, "wb")) == NULL) {
+    snprintf(msg, sizeof(msg), "Could not open %s in write_trace", path);
+    unix_error(msg);
+  }
+
+  memset(&hdr, 0, sizeof(hdr));
+  strcpy(hdr.magic, TRACE_MAGIC);
+  hdr.version = TRACE_VERSION;
+  hdr.sugg_heapsize = trace->sugg_heapsize;
+  hdr.num_ids = trace->num_ids;
+  hdr.num_ops = trace->num_ops;
+  hdr.weight = trace->weight;
+  hdr.num_threads = trace->num_threads;
+  fwrite(&hdr, sizeof(hdr), 1, binfile);
+  for (i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = &trace->ops[i];
+    int flags = op->type;
+
+    if (op->thread)
+      flags |= TRACEREC_THREAD;
+    if (op->gap)
+      flags |= TRACEREC_GAP;
+    putc(flags, binfile);
+    put_varint(binfile, op->index);
+    if (op->type != FREE)
+      put_varint(binfile, op->size);
+    if (op->type == CALLOC)
+      put_varint(binfile, op->nmemb);
+    if (op->type == MEMALIGN)
+      put_varint(binfile, op->align);
+    if (op->thread)
+      put_varint(binfile, op->thread);
+    if (op->gap)
+      put_varint(binfile, op->gap);
+  }
+  if (ferror(binfile) || fclose(binfile) != 0) {
+    snprintf(msg, sizeof(msg), "Could not write %s in write_trace", path);
+    unix_error(msg);
+  }
+  if (verbose > 1) {
+    printf("Wrote binary tracefile: %s\n", path);
+  }
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ *              to, all of which were allocated in read_trace() or
+ *              map_trace().
  */
 void free_trace(trace_t *trace) {
   free(trace->ops);         /* free the three arrays... */
@@ -499,10 +958,12 @@ static double eval_mm_util(const malloc_impl_t *impl, trace_t *trace, int tracen
     switch (trace->ops[i].type) {
 
       case ALLOC: /* alloc */
+      case CALLOC:
+      case MEMALIGN:
         index = trace->ops[i].index;
         size = trace->ops[i].size;
 
-        if ((p = (char *) impl->malloc(size)) == NULL) {
+        if ((p = (char *) trace_alloc(impl, &trace->ops[i])) == NULL) {
           app_error("malloc failed in eval_mm_util");
         }
 
@@ -578,58 +1039,513 @@ static void mem_op(volatile char *raddr, volatile char *waddr) {
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(const malloc_impl_t *impl, trace_t *trace) {
-  int i, index, size, newsize;
-  char *p, *newp, *oldp, *block;
-
   /* Reset the heap and initialize the mm package */
   mem_reset_brk();
   if (impl->init() < 0) {
     app_error("init failed in eval_mm_speed");
   }
 
+  replay_trace(impl, trace, trace->blocks);
+}
+
+/* Replays one request, on the blocks in blocks */
+static inline void replay_op(const malloc_impl_t *impl, traceop_t *op,
+                             char **blocks) {
+  int index, size, newsize;
+  char *p, *newp, *oldp, *block;
+
+  switch (op->type) {
+
+    case ALLOC: /* malloc */
+    case CALLOC:
+    case MEMALIGN:
+      index = op->index;
+      if ((p = (char *) trace_alloc(impl, op)) == NULL)
+        app_error("malloc error in replay_trace");
+      blocks[index] = p;
+      break;
+
+    case REALLOC: /* realloc */
+      index = op->index;
+      newsize = op->size;
+      oldp = blocks[index];
+      if ((newp = (char *) impl->realloc(oldp,newsize)) == NULL)
+        app_error("realloc error in replay_trace");
+      blocks[index] = newp;
+      break;
+
+    case FREE: /* free */
+      index = op->index;
+      block = blocks[index];
+      impl->free(block);
+      break;
+
+    case WRITE: /* write */
+      index = op->index;
+      size = op->size;
+      p = blocks[index];
+      if (size > 1) {
+        /* read bytes, do some computation, and write */
+        for (int offset = 1; offset < size; offset++) {
+          mem_op(p + offset - 1, p + offset);
+        }
+      }
+      break;
+
+    default:
+      app_error("Nonexistent request type in replay_trace");
+  }
+}
+
+/*
+ * replay_trace - Interprets each request of the trace, keeping the
+ *    pointers malloc and realloc return in blocks.
+ */
+static void replay_trace(const malloc_impl_t *impl, trace_t *trace,
+                         char **blocks) {
+  int i;
+
   /* Interpret each trace request */
+  for (i = 0; i < trace->num_ops; i++)
+    replay_op(impl, &trace->ops[i], blocks);
+}
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Waits out an op's recorded gap after the thread's last op, which was
+   due at *due */
+static void pace(traceop_t *op, double *due) {
+  *due += op->gap / 1e9;
+  while (now() < *due)
+    sched_yield();
+}
+
+/* Replays a copy of the trace in run's row id of blocks, with gaps.
+   Returns the number of ops replayed. */
+static int replay_paced(threads_t *run, int id) {
+  trace_t *trace = run->trace;
+  double due = now();
+  int i;
+
   for (i = 0; i < trace->num_ops; i++) {
-    switch (trace->ops[i].type) {
+    pace(&trace->ops[i], &due);
+    replay_op(run->impl, &trace->ops[i], run->blocks[id]);
+  }
+  return trace->num_ops;
+}
 
-      case ALLOC: /* malloc */
-        index = trace->ops[i].index;
-        size = trace->ops[i].size;
-        if ((p = (char *) impl->malloc(size)) == NULL)
-          app_error("malloc error in eval_mm_speed");
-        trace->blocks[index] = p;
-        break;
+/* Replays the ops of the trace's threads that fall to thread id, in
+   trace order per block, with gaps if replay_gaps is set.  A gap counts
+   from the last op of its own trace thread, so each of those keeps its
+   own due time.  Returns the number of ops replayed. */
+static int replay_partition(threads_t *run, int id) {
+  trace_t *trace = run->trace;
+  char **blocks = run->blocks[0];
+  double due[trace->num_threads];
+  int i, n = 0;
+
+  for (i = 0; i < trace->num_threads; i++)
+    due[i] = now();
+  for (i = 0; i < trace->num_ops; i++) {
+    traceop_t *op = &trace->ops[i];
+    if (op->thread % run->num_threads != id)
+      continue;
+    if (replay_gaps)
+      pace(op, &due[op->thread]);
+    while (__atomic_load_n(&run->done[op->index], __ATOMIC_ACQUIRE) != run->seq[i])
+      sched_yield();
+    replay_op(run->impl, op, blocks);
+    __atomic_store_n(&run->done[op->index], run->seq[i] + 1, __ATOMIC_RELEASE);
+    n++;
+  }
+  return n;
+}
 
-      case REALLOC: /* realloc */
-        index = trace->ops[i].index;
-        newsize = trace->ops[i].size;
-        oldp = trace->blocks[index];
-        if ((newp = (char *) impl->realloc(oldp,newsize)) == NULL)
-          app_error("realloc error in eval_mm_speed");
-        trace->blocks[index] = newp;
-        break;
+static void *replay_thread(void *argp) {
+  thread_arg_t *arg = (thread_arg_t *)argp;
+  threads_t *run = arg->run;
+  double start;
+
+  pthread_barrier_wait(&run->start);
+  start = now();
+  if (run->trace->num_threads) {
+    run->thread_ops[arg->id] = replay_partition(run, arg->id);
+  } else if (replay_gaps) {
+    run->thread_ops[arg->id] = replay_paced(run, arg->id);
+  } else {
+    replay_trace(run->impl, run->trace, run->blocks[arg->id]);
+    run->thread_ops[arg->id] = run->trace->num_ops;
+  }
+  run->thread_secs[arg->id] = now() - start;
+  return NULL;
+}
 
-      case FREE: /* free */
-        index = trace->ops[i].index;
-        block = trace->blocks[index];
-        impl->free(block);
-        break;
+/*
+ * eval_mm_threads - This is the function that is used by fsecs() to
+ *    measure the running time of run->num_threads concurrent replays.
+ */
+static void eval_mm_threads(threads_t *run) {
+  pthread_t tids[run->num_threads];
+  thread_arg_t args[run->num_threads];
+  int i;
 
-      case WRITE: /* write */
-        index = trace->ops[i].index;
-        size = trace->ops[i].size;
-        p = trace->blocks[index];
-        if (size > 1) {
-          /* read bytes, do some computation, and write */
-          for (int offset = 1; offset < size; offset++) {
-            mem_op(p + offset - 1, p + offset);
-          }
-        }
-        break;
+  /* Reset the heap and initialize the mm package */
+  mem_reset_brk();
+  if (run->impl->init() < 0) {
+    app_error("init failed in eval_mm_threads");
+  }
 
-      default:
-        app_error("Nonexistent request type in eval_mm_speed");
+  if (run->trace->num_threads)
+    memset(run->done, 0, run->trace->num_ids * sizeof(int));
+  pthread_barrier_init(&run->start, NULL, run->num_threads);
+  for (i = 0; i < run->num_threads; i++) {
+    args[i].run = run;
+    args[i].id = i;
+    if (pthread_create(&tids[i], NULL, replay_thread, &args[i]) != 0)
+      unix_error("pthread_create failed in eval_mm_threads");
+  }
+  for (i = 0; i < run->num_threads; i++)
+    pthread_join(tids[i], NULL);
+  pthread_barrier_destroy(&run->start);
+}
+
+/*
+ * eval_mm_aggregate - Returns the aggregate throughput of impl on
+ *    run->num_threads threads, and sets per_thread to the mean throughput
+ *    of a single thread.
+ */
+static double eval_mm_aggregate(threads_t *run, const malloc_impl_t *impl,
+                                double *per_thread) {
+  double secs, ops = 0, thread_rate = 0;
+  int i;
+
+  run->impl = impl;
+  secs = fsecs((void (*)(void *))eval_mm_threads, run);
+  for (i = 0; i < run->num_threads; i++) {
+    ops += run->thread_ops[i];
+    if (run->thread_secs[i] > 0)
+      thread_rate += run->thread_ops[i] / run->thread_secs[i];
+  }
+  *per_thread = thread_rate / run->num_threads;
+  return ops / secs;
+}
+
+/*
+ * eval_mm_scaling - Prints the aggregate and mean per-thread throughput
+ *    of the mm package, and the aggregate throughput of libc, on each of
+ *    1..max_threads threads.  The threads replay a copy of the trace each,
+ *    or split a trace with thread ids between them.
+ */
+static void eval_mm_scaling(trace_t *trace, char *tracefile, int max_threads) {
+  threads_t run;
+  double mm, libc, per_thread, unused, base = 0;
+  int i, n;
+
+  run.trace = trace;
+  if ((run.blocks = (char ***)malloc(max_threads * sizeof(char **))) == NULL ||
+      (run.thread_ops = (double *)malloc(max_threads * sizeof(double))) == NULL ||
+      (run.thread_secs = (double *)malloc(max_threads * sizeof(double))) == NULL)
+    unix_error("malloc failed in eval_mm_scaling");
+  for (i = 0; i < max_threads; i++) {
+    if ((run.blocks[i] = (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+      unix_error("malloc failed in eval_mm_scaling");
+  }
+
+  /* Number each op by the ops on its block before it */
+  run.seq = run.done = NULL;
+  if (trace->num_threads) {
+    if ((run.seq = (int *)malloc(trace->num_ops * sizeof(int))) == NULL ||
+        (run.done = (int *)calloc(trace->num_ids, sizeof(int))) == NULL)
+      unix_error("malloc failed in eval_mm_scaling");
+    for (i = 0; i < trace->num_ops; i++)
+      run.seq[i] = run.done[trace->ops[i].index]++;
+  }
+
+  for (n = 1; n <= max_threads; n++) {
+    run.num_threads = n;
+    mm = eval_mm_aggregate(&run, &my_impl, &per_thread);
+    libc = eval_mm_aggregate(&run, &libc_impl, &unused);
+    if (n == 1)
+      base = mm;
+    printf("%30s%8d%10.0f%11.0f%10.0f%8.2fx%8.2fx\n", tracefile, n,
+           mm / 1e3, per_thread / 1e3, libc / 1e3, mm / libc, mm / base);
+  }
+
+  for (i = 0; i < max_threads; i++)
+    free(run.blocks[i]);
+  free(run.blocks);
+  free(run.thread_ops);
+  free(run.thread_secs);
+  free(run.seq);
+  free(run.done);
+}
+
+/* Churn: each -M thread mallocs the trace's small allocation sizes in
+   batches of CROWD_BATCH, freeing each batch before the next */
+#define CROWD_SIZE 1024
+#define CROWD_BATCH 8
+
+static void *crowd_thread(void *argp) {
+  thread_arg_t *arg = (thread_arg_t *)argp;
+  threads_t *run = arg->run;
+  trace_t *trace = run->trace;
+  char *batch[CROWD_BATCH];
+  int i, j, n = 0;
+
+  pthread_barrier_wait(&run->start);
+  for (i = 0; i < trace->num_ops; i++) {
+    if (!IS_ALLOC(trace->ops[i].type) || trace->ops[i].size > CROWD_SIZE)
+      continue;
+    if ((batch[n++] = trace_alloc(run->impl, &trace->ops[i])) == NULL)
+      app_error("malloc failed in crowd_thread");
+    if (n == CROWD_BATCH) {
+      for (j = 0; j < n; j++)
+        run->impl->free(batch[j]);
+      n = 0;
     }
   }
+  for (j = 0; j < n; j++)
+    run->impl->free(batch[j]);
+  return NULL;
+}
+
+/*
+ * eval_mm_crowd - This is the function that is used by fsecs() to
+ *    measure the running time of run->num_threads churning threads.
+ */
+static void eval_mm_crowd(threads_t *run) {
+  pthread_t *tids;
+  thread_arg_t *args;
+  int i;
+
+  /* Reset the heap and initialize the mm package */
+  mem_reset_brk();
+  if (run->impl->init() < 0) {
+    app_error("init failed in eval_mm_crowd");
+  }
+
+  if ((tids = (pthread_t *)malloc(run->num_threads * sizeof(pthread_t))) == NULL ||
+      (args = (thread_arg_t *)malloc(run->num_threads * sizeof(thread_arg_t))) == NULL)
+    unix_error("malloc failed in eval_mm_crowd");
+  pthread_barrier_init(&run->start, NULL, run->num_threads);
+  for (i = 0; i < run->num_threads; i++) {
+    args[i].run = run;
+    args[i].id = i;
+    if (pthread_create(&tids[i], NULL, crowd_thread, &args[i]) != 0)
+      unix_error("pthread_create failed in eval_mm_crowd");
+  }
+  for (i = 0; i < run->num_threads; i++)
+    pthread_join(tids[i], NULL);
+  pthread_barrier_destroy(&run->start);
+  run->heap = (char *)run->impl->heap_hi() + 1 - (char *)run->impl->heap_lo();
+  free(tids);
+  free(args);
+}
+
+/*
+ * eval_mm_crowds - Prints the throughput of libc and of the mm package
+ *    with num_threads threads churning small blocks at once, and the
+ *    heap the mm package needed.  Blocks a thread caches are lost to
+ *    the others, so per-thread caches grow the heap with the threads.
+ */
+static void eval_mm_crowds(trace_t *trace, char *tracefile, int num_threads) {
+  threads_t run;
+  double ops = 0, libc_secs, mm_secs;
+  int i;
+
+  for (i = 0; i < trace->num_ops; i++) {
+    if (IS_ALLOC(trace->ops[i].type) && trace->ops[i].size <= CROWD_SIZE)
+      ops += 2;
+  }
+  if (ops == 0)
+    return;
+  ops *= num_threads;
+
+  run.trace = trace;
+  run.num_threads = num_threads;
+  run.impl = &libc_impl;
+  libc_secs = fsecs((void (*)(void *))eval_mm_crowd, &run);
+  run.impl = &my_impl;
+  mm_secs = fsecs((void (*)(void *))eval_mm_crowd, &run);
+  printf("%30s%10.0f%10.0f%10zu\n", tracefile, ops / libc_secs / 1e3,
+         ops / mm_secs / 1e3, run.heap / 1024);
+}
+
+/* Mallocs the trace's allocation sizes, passing each block to the
+   consumer through the ring */
+static void *produce_thread(void *argp) {
+  pair_arg_t *arg = (pair_arg_t *)argp;
+  pairs_t *run = arg->run;
+  ring_t *ring = &run->rings[arg->id];
+  trace_t *trace = run->trace;
+  size_t head = 0;
+  int i;
+
+  pthread_barrier_wait(&run->start);
+  for (i = 0; i < trace->num_ops; i++) {
+    if (!IS_ALLOC(trace->ops[i].type))
+      continue;
+    char *p = trace_alloc(run->impl, &trace->ops[i]);
+    if (p == NULL)
+      app_error("malloc failed in produce_thread");
+    while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == RING_SLOTS)
+      sched_yield();
+    ring->slots[head % RING_SLOTS] = p;
+    __atomic_store_n(&ring->head, ++head, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+/* Frees every block the producer passes through the ring */
+static void *consume_thread(void *argp) {
+  pair_arg_t *arg = (pair_arg_t *)argp;
+  pairs_t *run = arg->run;
+  ring_t *ring = &run->rings[arg->id];
+  trace_t *trace = run->trace;
+  size_t tail = 0;
+  int i;
+
+  pthread_barrier_wait(&run->start);
+  for (i = 0; i < trace->num_ops; i++) {
+    if (!IS_ALLOC(trace->ops[i].type))
+      continue;
+    while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+      sched_yield();
+    run->impl->free(ring->slots[tail % RING_SLOTS]);
+    __atomic_store_n(&ring->tail, ++tail, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+/*
+ * eval_mm_pairs - This is the function that is used by fsecs() to
+ *    measure the running time of run->num_pairs producer/consumer pairs.
+ */
+static void eval_mm_pairs(pairs_t *run) {
+  int n = 2 * run->num_pairs;
+  pthread_t tids[n];
+  pair_arg_t args[run->num_pairs];
+  int i;
+
+  /* Reset the heap and initialize the mm package */
+  mem_reset_brk();
+  if (run->impl->init() < 0) {
+    app_error("init failed in eval_mm_pairs");
+  }
+
+  memset(run->rings, 0, run->num_pairs * sizeof(ring_t));
+  pthread_barrier_init(&run->start, NULL, n);
+  for (i = 0; i < run->num_pairs; i++) {
+    args[i].run = run;
+    args[i].id = i;
+    if (pthread_create(&tids[2 * i], NULL, produce_thread, &args[i]) != 0 ||
+        pthread_create(&tids[2 * i + 1], NULL, consume_thread, &args[i]) != 0)
+      unix_error("pthread_create failed in eval_mm_pairs");
+  }
+  for (i = 0; i < n; i++)
+    pthread_join(tids[i], NULL);
+  pthread_barrier_destroy(&run->start);
+}
+
+/*
+ * eval_mm_frees - Prints the throughput of num_pairs producer/consumer
+ *    pairs under libc, under the arenas with every free taking the
+ *    owning arena's lock, and under the arenas' remote free lists.
+ */
+static void eval_mm_frees(trace_t *trace, char *tracefile, int num_pairs) {
+  const malloc_impl_t *impls[] = {&libc_impl, &arena_locked_impl, &arena_impl};
+  double throughput[3];
+  double ops = 0;
+  pairs_t run;
+  int i;
+
+  for (i = 0; i < trace->num_ops; i++) {
+    if (IS_ALLOC(trace->ops[i].type))
+      ops += 2;
+  }
+  ops *= num_pairs;
+
+  run.trace = trace;
+  run.num_pairs = num_pairs;
+  if ((run.rings = (ring_t *)malloc(num_pairs * sizeof(ring_t))) == NULL)
+    unix_error("malloc failed in eval_mm_frees");
+  for (i = 0; i < 3; i++) {
+    run.impl = impls[i];
+    throughput[i] = ops / fsecs((void (*)(void *))eval_mm_pairs, &run);
+  }
+  printf("%30s%10.0f%10.0f%10.0f%8.2fx\n", tracefile, throughput[0] / 1e3,
+         throughput[1] / 1e3, throughput[2] / 1e3, throughput[2] / throughput[1]);
+  free(run.rings);
+}
+
+/*
+ * eval_mm_latency - Returns the worst-case latency in cycles of a single
+ *    malloc, free or realloc in the trace.  Each op counts the fastest of
+ *    LATENCY_RUNS replays, so an op is slow only if it is slow every time.
+ */
+static double eval_mm_latency(const malloc_impl_t *impl, trace_t *trace) {
+  int i, run, index;
+  char *p;
+  double cycles, max_cycles = 0;
+  double *best;
+
+  if ((best = (double *)malloc(trace->num_ops * sizeof(double))) == NULL) {
+    unix_error("malloc failed in eval_mm_latency");
+  }
+
+  for (run = 0; run < LATENCY_RUNS; run++) {
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (impl->init() < 0) {
+      app_error("init failed in eval_mm_latency");
+    }
+
+    for (i = 0; i < trace->num_ops; i++) {
+      index = trace->ops[i].index;
+      start_counter();
+      switch (trace->ops[i].type) {
+
+        case ALLOC: /* malloc */
+        case CALLOC:
+        case MEMALIGN:
+          if ((p = (char *) trace_alloc(impl, &trace->ops[i])) == NULL)
+            app_error("malloc error in eval_mm_latency");
+          trace->blocks[index] = p;
+          break;
+
+        case REALLOC: /* realloc */
+          if ((p = (char *) impl->realloc(trace->blocks[index],
+                                          trace->ops[i].size)) == NULL)
+            app_error("realloc error in eval_mm_latency");
+          trace->blocks[index] = p;
+          break;
+
+        case FREE: /* free */
+          impl->free(trace->blocks[index]);
+          break;
+
+        case WRITE: /* write, not an allocator op */
+          break;
+
+        default:
+          app_error("Nonexistent request type in eval_mm_latency");
+      }
+      cycles = get_counter();
+      if (run == 0 || cycles < best[i])
+        best[i] = cycles;
+    }
+  }
+
+  for (i = 0; i < trace->num_ops; i++) {
+    if (trace->ops[i].type != WRITE && best[i] > max_cycles)
+      max_cycles = best[i];
+  }
+  free(best);
+  return max_cycles;
 }
 
 /*
@@ -637,7 +1553,7 @@ static void eval_mm_speed(const malloc_impl_t *impl, trace_t *trace) {
  *    implementation.  Returns 0 on check failure, and 1 on pass.
  */
 static int eval_mm_check(const malloc_impl_t *impl, trace_t *trace, int tracenum) {
-  int i, index, size, newsize;
+  int i, index, newsize;
   char *p, *newp, *oldp, *block;
 
   /* Reset the heap and initialize the mm package */
@@ -650,9 +1566,10 @@ static int eval_mm_check(const malloc_impl_t *impl, trace_t *trace, int tracenum
     switch (trace->ops[i].type) {
 
       case ALLOC: /* malloc */
+      case CALLOC:
+      case MEMALIGN:
         index = trace->ops[i].index;
-        size = trace->ops[i].size;
-        if ((p = (char *) impl->malloc(size)) == NULL) {
+        if ((p = (char *) trace_alloc(impl, &trace->ops[i])) == NULL) {
           malloc_error(tracenum, i, "impl malloc failed.");
           return 0;
         }
@@ -697,6 +1614,35 @@ static int eval_mm_check(const malloc_impl_t *impl, trace_t *trace, int tracenum
  ************************************/
 
 
+/*
+ * printcompare - prints the throughput, utilization and worst-case op
+ *    latency of the mm and TLSF packages side by side
+ */
+static void printcompare(int n, char **tracefiles, stats_t *mm_stats,
+                         stats_t *tlsf_stats) {
+  int i;
+
+  printf("%30s%10s%10s%7s%7s%12s%12s\n", "", "Kops/sec", "", "util", "",
+         "max cycles", "");
+  printf("%30s%10s%10s%7s%7s%12s%12s\n",
+         "filename", "my", "tlsf", "my", "tlsf", "my", "tlsf");
+  for (i = 0; i < n; i++) {
+    if (!mm_stats[i].valid || !tlsf_stats[i].valid) {
+      printf("%30s%10s%10s%7s%7s%12s%12s\n",
+             tracefiles[i], "-", "-", "-", "-", "-", "-");
+      continue;
+    }
+    printf("%30s%10.0f%10.0f%6.0f%%%6.0f%%%12.0f%12.0f\n",
+           tracefiles[i],
+           mm_stats[i].ops / mm_stats[i].secs / 1e3,
+           tlsf_stats[i].ops / tlsf_stats[i].secs / 1e3,
+           mm_stats[i].util * 100.0,
+           tlsf_stats[i].util * 100.0,
+           mm_stats[i].max_cycles,
+           tlsf_stats[i].max_cycles);
+  }
+}
+
 /*
  * printresults - prints a performance summary for some malloc package
  */
@@ -785,12 +1731,18 @@ void malloc_error(int tracenum, int opnum, char *msg) {
  * usage - Explain the command line arguments
  */
 static void usage(void) {
-  fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+  fprintf(stderr, "Usage: mdriver [-hvValcsG] [-f <file>] [-t <dir>] [-T <n>] [-P <n>] [-M <n>] [-B <dir>]\n");
   fprintf(stderr, "Options\n");
+  fprintf(stderr, "\t-B <dir>   Write the traces to <dir> as binary traces and exit.\n");
   fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+  fprintf(stderr, "\t-G         With -T, wait out each request's recorded gap.\n");
   fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
   fprintf(stderr, "\t-h         Print this message.\n");
+  fprintf(stderr, "\t-M <n>     Churn small blocks on n threads at once (THREAD_SAFE=1).\n");
+  fprintf(stderr, "\t-P <n>     Free each block on another thread, in n producer/consumer pairs.\n");
+  fprintf(stderr, "\t-s         Compare against TLSF malloc, with worst-case op latency.\n");
   fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+  fprintf(stderr, "\t-T <n>     Replay each trace, or its threads, on 1..n threads (THREAD_SAFE=1).\n");
   fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
   fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
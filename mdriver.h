@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <dirent.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,7 +26,9 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
-typedef enum {ALLOC, FREE, REALLOC, WRITE} traceop_type; /* type of request */
+/* type of request */
+typedef enum {ALLOC, FREE, REALLOC, WRITE, CALLOC, MEMALIGN} traceop_type;
+#define IS_ALLOC(type) ((type) == ALLOC || (type) == CALLOC || (type) == MEMALIGN)
 /******************************
  * The key compound data types
  *****************************/
@@ -35,6 +38,10 @@ typedef struct {
   traceop_type  type; /* type of request */
   int index;                        /* index for free() to use later */
   int size;                         /* byte size of alloc/realloc request */
+  int nmemb;                        /* elements of a calloc, size/nmemb each */
+  int thread;                       /* thread that made the request */
+  int align;                        /* alignment of a memalign request */
+  unsigned gap;                     /* ns since the thread's last request */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -43,15 +50,57 @@ typedef struct {
   int num_ids;         /* number of alloc/realloc ids */
   int num_ops;         /* number of distinct requests */
   int weight;          /* weight for this trace (unused) */
+  int num_threads;     /* 1 + largest thread id, 0 if the trace has none */
   traceop_t *ops;      /* array of requests */
   char **blocks;       /* array of ptrs returned by malloc/realloc... */
   size_t *block_sizes; /* ... and a corresponding array of payload sizes */
 } trace_t;
 
+/* Header of a binary trace file (written by mdriver -B).  num_ops packed
+   records follow it, independent of traceop_t's layout.  Each is a type
+   byte, holding the traceop_type and the TRACEREC_* flags, then varints
+   (7 bits a byte, low bits first, high bit set on all but the last):
+   the index; the size, unless the op is a FREE; the nmemb of a CALLOC;
+   the align of a MEMALIGN; and the thread and the gap if flagged. */
+#define TRACE_MAGIC   "MDTRACE"
+#define TRACE_VERSION 3
+typedef struct {
+  char magic[8];       /* TRACE_MAGIC, NUL-terminated */
+  uint32_t version;    /* TRACE_VERSION */
+  int32_t sugg_heapsize;
+  int32_t num_ids;
+  int32_t num_ops;
+  int32_t weight;
+  int32_t num_threads;
+} tracehdr_t;
+#define TRACEREC_TYPE   0x07 /* the traceop_type */
+#define TRACEREC_THREAD 0x08 /* a thread follows */
+#define TRACEREC_GAP    0x10 /* a gap follows */
+
 /*********************
  * Function prototypes
  *********************/
 
+/* Makes the allocation an ALLOC, CALLOC or MEMALIGN request asks for.  A
+   package without calloc or memalign gets the nearest malloc instead. */
+static inline void *trace_alloc(const malloc_impl_t *impl, traceop_t *op) {
+  void *p;
+  switch (op->type) {
+    case CALLOC:
+      if (impl->calloc)
+        return impl->calloc(op->nmemb, op->nmemb ? op->size / op->nmemb : 0);
+      if ((p = impl->malloc(op->size)) != NULL)
+        memset(p, 0, op->size);
+      return p;
+    case MEMALIGN:
+      if (impl->memalign)
+        return impl->memalign(op->align, op->size);
+      return impl->malloc(op->size);
+    default:
+      return impl->malloc(op->size);
+  }
+}
+
 void malloc_error(int tracenum, int opnum, char *msg);
 void unix_error(char *msg);
 void app_error(char *msg);
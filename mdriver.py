@@ -40,20 +40,23 @@ if __name__ == '__main__':
   total_accuracy = 0.0
   num_trace_files = 0
 
+  # One build serves every trace class: the strategy, the range thresholds
+  # and the size class tables are all chosen at runtime from the
+  # TRACE_CLASS environment variable.
+  subprocess.check_call('make clean mdriver DEBUG=0 >/dev/null', shell=True)
+
   for trace_file in trace_files:
     print 'trace_file:' + trace_file
 
+    env = dict(os.environ)
+    env.pop('TRACE_CLASS', None)
     m = re.search('trace_c(\d)_v(\d)', trace_file)
     if m == None:
       print '# Trace file {0} does not match trace_c{{C}}_v{{V}} pattern.'.format(trace_file)
-      subprocess.check_call('make clean mdriver DEBUG=0 >/dev/null', shell=True)
     else:
-      trace_class = m.group(1)
-      subprocess.check_call('make clean mdriver DEBUG=0'
-          ' PARAMS="-D TRACE_CLASS={0}" >/dev/null'.format(trace_class),
-          shell=True)
+      env['TRACE_CLASS'] = m.group(1)
 
-    proc = subprocess.Popen('./mdriver -g -f ' + trace_file, shell=True, stdout=subprocess.PIPE)
+    proc = subprocess.Popen('./mdriver -g -f ' + trace_file, shell=True, stdout=subprocess.PIPE, env=env)
     stdout, _ = proc.communicate()
     print stdout
     assert(proc.returncode == 0)
@@ -1,6 +1,7 @@
 #!/usr/bin/env python
 #
 from opentuner import ConfigurationManipulator
+from opentuner.search.manipulator import IntegerParameter
 from opentuner.search.manipulator import PowerOfTwoParameter
 
 mdriver_manipulator = ConfigurationManipulator()
@@ -15,3 +16,13 @@ you have at least one other parameters, feel free to remove ALIGNMENT.
 mdriver_manipulator.add_parameter(PowerOfTwoParameter('ALIGNMENT', 8, 8))
 mdriver_manipulator.add_parameter(PowerOfTwoParameter('MIN_SIZE', 1, 1 << 17))
 mdriver_manipulator.add_parameter(PowerOfTwoParameter('MIN_DIFF', 1, 1 << 17))
+mdriver_manipulator.add_parameter(IntegerParameter('SUB_BIN_BITS', 0, 3))
+mdriver_manipulator.add_parameter(PowerOfTwoParameter('GROW_SIZE', 8, 1 << 16))
+mdriver_manipulator.add_parameter(IntegerParameter('QUICK_MAX_SIZE', 0, 1024))
+mdriver_manipulator.add_parameter(PowerOfTwoParameter('QUICK_LIMIT', 1, 1 << 12))
+mdriver_manipulator.add_parameter(PowerOfTwoParameter('LARGE_MIN_SIZE', 64, 1 << 16))
+mdriver_manipulator.add_parameter(IntegerParameter('LIST_POLICY', 0, 2))
+mdriver_manipulator.add_parameter(IntegerParameter('POW2_GEN_CLASSES', 0, 1))
+mdriver_manipulator.add_parameter(IntegerParameter('ADAPTIVE', 0, 1))
+mdriver_manipulator.add_parameter(PowerOfTwoParameter('PROBE_OPS', 64, 1 << 12))
+mdriver_manipulator.add_parameter(PowerOfTwoParameter('PROBE_HEAP', 1 << 12, 1 << 20))
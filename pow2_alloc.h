@@ -24,8 +24,11 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <assert.h>
 #include "./allocator_interface.h"
+#include "./config.h"
 #include "./memlib.h"
+#include "./size_class.h"
 
 // Don't call libc malloc!
 #define malloc(...) (USE_MY_MALLOC)
@@ -49,12 +52,45 @@
 // The smallest aligned size that will hold a size_t value.
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
+// Set to 1 to use the size classes sizegen derived from the traces for
+// the trace class my_set_class chose (size_classes.h) instead of powers of
+// two.
+#ifndef POW2_GEN_CLASSES
+#define POW2_GEN_CLASSES 0
+#endif
+
+#if POW2_GEN_CLASSES
+#include "./size_classes.h"
+#define BIN_SIZE GEN_MAX_CLASSES
+#else
 // 2^26 > 50 MB which is max size of alloc request.
 #define BIN_SIZE 26
+#endif
 
 // Shift fixed sizes based on tuning.
 #define FIXED_SHIFT 0
 
+// In slab mode each size class 2^k owns SLAB_SIZE-aligned slabs carved
+// into headerless objects, and free() recovers the class from the slab's
+// entry in SlabClass.  Otherwise every object carries a size_t header.
+#ifndef POW2_SLAB
+#define POW2_SLAB 1
+#endif
+
+// Must be a power of two.  Objects of SLAB_SIZE bytes or more get a run of
+// slabs to themselves.
+#ifndef SLAB_SIZE
+#define SLAB_SIZE 4096
+#endif
+
+// The smallest class must hold a free list Node.  sizegen never makes a
+// class below that.
+#if POW2_GEN_CLASSES
+#define MIN_CLASS 0
+#else
+#define MIN_CLASS 3
+#endif
+
 struct free_list_node {
   struct free_list_node *next;
 };
@@ -64,22 +100,134 @@ typedef struct free_list_node Node;
 #define NODE_SIZE (ALIGN(sizeof(NODE)))
 
 // holds the Node* lists.
-Node* FreeList[BIN_SIZE];
-// holds the fixed size associated with each bin.
-size_t fixed_sizes[BIN_SIZE];
+static Node* FreeList[BIN_SIZE];
+
+// The trace class my_set_class chose, -1 for none.
+static int pow2_class = TRACE_CLASS;
+
+#if POW2_GEN_CLASSES
+// The classes of the current heap, chosen by my_init.
+static const gen_table_t *gen = &gen_tables[GEN_NUM_TRACE_CLASSES];
+// Bins the current heap uses.
+#define NUM_CLASSES_IN_USE (gen->num_classes)
+
+// Returns the size of the objects in class k.
+static inline size_t class_size(size_t k) {
+  return gen->size[k];
+}
+
+// Returns the class of an object of size bytes, i.e. the smallest k with
+// size <= class_size(k).  Small sizes are a table lookup.
+static inline size_t size_class(size_t size) {
+  if (size <= GEN_LUT_MAX)
+    return gen->lut[(size + GEN_LUT_GRAIN - 1) / GEN_LUT_GRAIN];
+  size_t lo = gen->lut[GEN_LUT_ENTRIES - 1];
+  size_t hi = gen->num_classes - 1;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (gen->size[mid] < size)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+#else
+#define NUM_CLASSES_IN_USE BIN_SIZE
+
+// Returns the size of the objects in class k.
+static inline size_t class_size(size_t k) {
+  return (size_t)1 << k;
+}
+
+// Returns the class of an object of size bytes, i.e. the smallest k with
+// size <= 2^k.
+static inline size_t size_class(size_t size) {
+  size_t k = size_to_bin(size);
+  return k < MIN_CLASS ? MIN_CLASS : k;
+}
+#endif
+
+#if POW2_SLAB
+// One entry per slab of the heap: the class of the objects in a slab.
+// Slabs that continue an object started in an earlier slab are never
+// looked up.
+#define NUM_SLABS (MAX_HEAP / SLAB_SIZE + 1)
+static uint8_t SlabClass[NUM_SLABS];
+// The first SLAB_SIZE-aligned address of the heap.
+static char* slab_base;
+
+_Static_assert((SLAB_SIZE & (SLAB_SIZE - 1)) == 0,
+               "SLAB_SIZE must be a power of two");
+
+// Index into SlabClass of the slab holding p.
+static inline size_t slab_of(void* p) {
+  return ((char*)p - slab_base) / SLAB_SIZE;
+}
+
+// Bytes of heap a slab of class k takes: one slab, or enough whole slabs
+// for a single object.
+static inline size_t slab_run(size_t k) {
+  size_t obj = class_size(k);
+  return obj < SLAB_SIZE ? SLAB_SIZE : (obj + SLAB_SIZE - 1) & ~(SLAB_SIZE - 1);
+}
+#else
+// holds the fixed size associated with each bin.  A block's header holds
+// its bin index, so free never has to search for it.
+static size_t fixed_sizes[BIN_SIZE];
+// The first block, which is heap_lo unless another strategy owns the heap
+// below it.
+static char* heap_base;
+#endif
 
 // check - This checks our invariant that the size_t header before every
 // block points to either the beginning of the next block, or the end of the
 // heap.
 int my_check() {
+#if POW2_SLAB
+  char *hi = (char*)mem_heap_hi() + 1;
+  char *p = slab_base;
+
+  // Every run of slabs starts with its class and covers whole slabs.
+  while (p < hi) {
+    size_t k = SlabClass[slab_of(p)];
+    if (k < MIN_CLASS || k >= NUM_CLASSES_IN_USE) {
+      printf("Slab %p has bad class %lu\n", p, k);
+      return -1;
+    }
+    p += slab_run(k);
+  }
+  if (p != hi) {
+    printf("Slabs did not end at heap_hi!\n");
+    return -1;
+  }
+
+  for (int i = 0; i < BIN_SIZE; i++) {
+    for (Node *n = FreeList[i]; n; n = n->next) {
+      char *slab = slab_base + slab_of(n) * SLAB_SIZE;
+      if ((char*)n < slab_base || (char*)n >= hi ||
+          SlabClass[slab_of(n)] != i ||
+          ((char*)n - slab) % class_size(i)) {
+        printf("Bin %d had a bad node %p\n", i, n);
+        return -1;
+      }
+    }
+  }
+  return 0;
+#else
   char *p;
-  char *lo = (char*)mem_heap_lo();
+  char *lo = heap_base;
   char *hi = (char*)mem_heap_hi() + 1;
   size_t size = 0;
 
   p = lo;
   while (lo <= p && p < hi) {
-    size = *(size_t*)p;
+    size_t index = *(size_t*)p;
+    if (index >= NUM_CLASSES_IN_USE) {
+      printf("Block %p has bad bin %lu\n", p, index);
+      return -1;
+    }
+    size = fixed_sizes[index];
     p += size;
   }
 
@@ -90,21 +238,131 @@ int my_check() {
   }
 
   return 0;
+#endif
+}
+
+// Picks the classes of heaps that my_init lays down from now on for
+// trace_class, -1 for none.
+void my_set_class(int trace_class) {
+  pow2_class = trace_class;
 }
 
 // init - Initialize the malloc package.  Called once before any other
 // calls are made.  Since this is a very simple implementation, we just
 // return success.
 int my_init() {
+#if POW2_GEN_CLASSES
+  gen = &gen_tables[pow2_class >= 0 && pow2_class < GEN_NUM_TRACE_CLASSES ?
+                    pow2_class : GEN_NUM_TRACE_CLASSES];
+#endif
   for(int i=0; i < BIN_SIZE; i++) {
     // Initialize all bins to NULL.
     FreeList[i] = NULL;
+#if !POW2_SLAB
     // TODO: We should tune the sizes we fix for each bin
-    fixed_sizes[i] = (1 << i) + SIZE_T_SIZE + FIXED_SHIFT;
+    if (i < NUM_CLASSES_IN_USE)
+      fixed_sizes[i] = class_size(i) + SIZE_T_SIZE + FIXED_SHIFT;
+#endif
   }
+#if POW2_SLAB
+  // Pad the heap so that slabs start SLAB_SIZE-aligned.
+  char *brk = (char*)mem_heap_hi() + 1;
+  size_t pad = -(uintptr_t)brk & (SLAB_SIZE - 1);
+  if (pad && mem_sbrk(pad) == (void *)-1)
+    return -1;
+  slab_base = brk + pad;
+  memset(SlabClass, 0, sizeof(SlabClass));
+#else
+  heap_base = (char*)mem_heap_hi() + 1;
+#endif
   return 0;
 }
 
+#if POW2_SLAB
+// Takes a fresh slab (or run of slabs) for class k from the heap.  Returns
+// its first object and puts the rest on FreeList[k].
+static void * refill(size_t k) {
+  size_t obj = class_size(k);
+  size_t run = slab_run(k);
+  char *p = mem_sbrk(run);
+
+  if (p == (void *)-1)
+    return NULL;
+  SlabClass[slab_of(p)] = k;
+
+  // Push from the top down so the list hands out ascending addresses.
+  for (char *q = p + (run / obj - 1) * obj; q > p; q -= obj) {
+    ((Node *)q)->next = FreeList[k];
+    FreeList[k] = (Node *)q;
+  }
+  return p;
+}
+
+//  malloc - Pop an object of the request's class, carving a new slab for
+//  the class when its list is empty.
+void * my_malloc(size_t size) {
+  assert (my_check() == 0);
+  size_t k = size_class(size ? size : 1);
+
+  // Take an item if it exists.
+  Node *c = FreeList[k];
+  if (c) {
+    FreeList[k] = c->next;
+    return (void *)c;
+  }
+  return refill(k);
+}
+
+// free - the slab an object lives in knows its class.
+void my_free(void *ptr) {
+  size_t k = SlabClass[slab_of(ptr)];
+  ((Node *)ptr)->next = FreeList[k];
+  FreeList[k] = (Node *)ptr;
+}
+
+// realloc - objects already have room up to their class size.
+void * my_realloc(void *ptr, size_t size) {
+  void *newptr;
+  if (!ptr)
+    return my_malloc(size);
+
+  size_t copy_size = class_size(SlabClass[slab_of(ptr)]);
+
+  if (size <= copy_size)
+    return ptr;
+
+  // Allocate a new chunk of memory, and fail if that allocation fails.
+  newptr = my_malloc(size);
+  if (NULL == newptr)
+    return NULL;
+
+  // The new object is larger, so the whole old one is copied.
+  memcpy(newptr, ptr, copy_size);
+
+  // Release the old block.
+  my_free(ptr);
+
+  // Return a pointer to the new block.
+  return newptr;
+}
+
+// usable_size - the whole object of the slab's class.
+size_t my_usable_size(void *ptr) {
+  return class_size(SlabClass[slab_of(ptr)]);
+}
+
+// memalign - Objects of class 2^k sit at multiples of 2^k within
+// SLAB_SIZE-aligned slabs, so any object at least alignment bytes long is
+// aligned, up to SLAB_SIZE.  Generated classes are not powers of two.
+void * my_memalign(size_t alignment, size_t size) {
+  if (alignment <= ALIGNMENT)
+    return my_malloc(size);
+  if (POW2_GEN_CLASSES || alignment > SLAB_SIZE)
+    return NULL;
+  return my_malloc(size > alignment ? size : alignment);
+}
+#else
+
 //  malloc - Allocate a block by incrementing the brk pointer.
 //  Always allocate a block whose size is a multiple of the alignment.
 void * my_malloc(size_t size) {
@@ -112,13 +370,10 @@ void * my_malloc(size_t size) {
   // We allocate a little bit of extra memory so that we can store the
   // size of the block we've allocated.  Take a look at realloc to see
   // one example of a place where this can come in handy.
-  int aligned_size = ALIGN(size + SIZE_T_SIZE);
-  int index;
-  for (index = 0; index < BIN_SIZE; index++) {
-    if (fixed_sizes[index] >= aligned_size) {
-      break;
-    }
-  }
+  size_t aligned_size = ALIGN(size + SIZE_T_SIZE);
+  // The smallest bin with fixed_sizes[index] >= aligned_size.
+  size_t payload = aligned_size - SIZE_T_SIZE;
+  size_t index = size_class(payload > FIXED_SHIFT ? payload - FIXED_SHIFT : 1);
 
   // Take an item if it exists.
   if (FreeList[index]) {
@@ -138,9 +393,9 @@ void * my_malloc(size_t size) {
     // the client code know that we weren't able to allocate memory.
     return NULL;
   } else {
-    // We store the size of the block we've allocated in the first
+    // We store the bin of the block we've allocated in the first
     // SIZE_T_SIZE bytes.
-    *(size_t*)p = fixed_sizes[index];
+    *(size_t*)p = index;
 
     // Then, we return a pointer to the rest of the block of memory,
     // which is at least size bytes long.  We have to cast to uint8_t
@@ -154,15 +409,8 @@ void * my_malloc(size_t size) {
 
 // free - inserts a freed node back in appropriate bin.
 void my_free(void *ptr) {
-  // Get the size by shifting back by SIZE_T_SIZE.
-  size_t ref_size = *(size_t *)((char *)ptr - SIZE_T_SIZE);
-  size_t index;
-  // Find the appropriate bin.
-  for (index = 0; index < BIN_SIZE; index++) {
-    if (ref_size == fixed_sizes[index]) {
-      break;
-    }
-  }
+  // Get the bin by shifting back by SIZE_T_SIZE.
+  size_t index = *(size_t *)((char *)ptr - SIZE_T_SIZE);
   // store the struct in user data to conserve space.
   // include in the correct bin in FreeList
   ((Node *)ptr)->next = FreeList[index];
@@ -176,14 +424,16 @@ void * my_realloc(void *ptr, size_t size) {
 
   // Allocate a new chunk of memory, and fail if that allocation fails.
   newptr = my_malloc(size);
+  if (!ptr)
+    return newptr;
   if (NULL == newptr)
     return NULL;
 
   // Get the size of the old block of memory.  Take a peek at my_malloc(),
   // where we stashed this in the SIZE_T_SIZE bytes directly before the
   // address we returned.  Now we can back up by that many bytes and read
-  // the size.
-  copy_size = *(size_t*)((uint8_t*)ptr - SIZE_T_SIZE);
+  // the bin, whose fixed size includes that header.
+  copy_size = fixed_sizes[*(size_t*)((uint8_t*)ptr - SIZE_T_SIZE)] - SIZE_T_SIZE;
 
   // If the new block is smaller than the old one, we have to stop copying
   // early so that we don't write off the end of the new block of memory.
@@ -200,6 +450,18 @@ void * my_realloc(void *ptr, size_t size) {
   return newptr;
 }
 
+// usable_size - the bin's fixed size, less the header holding the bin.
+size_t my_usable_size(void *ptr) {
+  return fixed_sizes[*(size_t*)((char*)ptr - SIZE_T_SIZE)] - SIZE_T_SIZE;
+}
+
+// memalign - Payloads follow a size_t header, so nothing beyond
+// ALIGNMENT.
+void * my_memalign(size_t alignment, size_t size) {
+  return alignment <= ALIGNMENT ? my_malloc(size) : NULL;
+}
+#endif
+
 // call mem_reset_brk.
 void my_reset_brk() {
   mem_reset_brk();
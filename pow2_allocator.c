@@ -0,0 +1,38 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// The pow2 strategy: pow2_alloc.h, power-of-two (or generated) size
+// classes that are never split or merged.  Its entry points are renamed
+// so that allocator.c can choose it at runtime alongside the others.
+#define my_init pow2_init
+#define my_malloc pow2_malloc
+#define my_realloc pow2_realloc
+#define my_free pow2_free
+#define my_check pow2_check
+#define my_reset_brk pow2_reset_brk
+#define my_heap_lo pow2_heap_lo
+#define my_heap_hi pow2_heap_hi
+#define my_usable_size pow2_usable_size
+#define my_memalign pow2_memalign
+#define my_set_class pow2_set_class
+
+#include "./pow2_alloc.h"
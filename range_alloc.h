@@ -26,6 +26,7 @@
 #include <string.h>
 #include "./allocator_interface.h"
 #include "./memlib.h"
+#include "./size_class.h"
 #include <assert.h>
 
 // Don't call libc malloc!
@@ -34,53 +35,26 @@
 #define realloc(...) (USE_MY_REALLOC)
 
 
-#ifndef MIN_SIZE
-  #if (TRACE_CLASS == 0)
-    #define MIN_SIZE 32
-  #elif (TRACE_CLASS == 1)
-    #define MIN_SIZE 4
-  #elif (TRACE_CLASS == 2)
-    #define MIN_SIZE 128
-  #elif (TRACE_CLASS == 3)
-    #define MIN_SIZE 8
-  #elif (TRACE_CLASS == 4)
-    #define MIN_SIZE 4
-  #elif (TRACE_CLASS == 5)
-    #define MIN_SIZE 4
-  #elif (TRACE_CLASS == 6)
-    #define MIN_SIZE 128
-  #elif (TRACE_CLASS == 7)
-    #define MIN_SIZE 1024
-  #elif (TRACE_CLASS == 8)
-    #define MIN_SIZE 16
-  #else
-    #define MIN_SIZE 64
-  #endif
+// The smallest block my_malloc hands out, and the surplus an allocated
+// block may keep rather than have it split off, tuned per trace class.
+// my_set_class picks the row; the last one serves any other class.
+// Defining MIN_SIZE or MIN_DIFF overrides every class, for tuning.
+#define NUM_TUNED_CLASSES 9
+#ifdef MIN_SIZE
+#define CLASS_MIN_SIZE(c) ((void)(c), (size_t)MIN_SIZE)
+#else
+static const size_t class_min_size[NUM_TUNED_CLASSES + 1] = {
+  32, 4, 128, 8, 4, 4, 128, 1024, 16, 64,
+};
+#define CLASS_MIN_SIZE(c) class_min_size[c]
 #endif
-
-
-#ifndef MIN_DIFF
-  #if (TRACE_CLASS == 0)
-    #define MIN_DIFF 16
-  #elif (TRACE_CLASS == 1)
-    #define MIN_DIFF 8
-  #elif (TRACE_CLASS == 2)
-    #define MIN_DIFF 16
-  #elif (TRACE_CLASS == 3)
-    #define MIN_DIFF 256
-  #elif (TRACE_CLASS == 4)
-    #define MIN_DIFF 128
-  #elif (TRACE_CLASS == 5)
-    #define MIN_DIFF 1
-  #elif (TRACE_CLASS == 6)
-    #define MIN_DIFF 1024
-  #elif (TRACE_CLASS == 7)
-    #define MIN_DIFF 128
-  #elif (TRACE_CLASS == 8)
-    #define MIN_DIFF 4
-  #else
-    #define MIN_DIFF 128
-  #endif
+#ifdef MIN_DIFF
+#define CLASS_MIN_DIFF(c) ((void)(c), (size_t)MIN_DIFF)
+#else
+static const size_t class_min_diff[NUM_TUNED_CLASSES + 1] = {
+  16, 8, 16, 256, 128, 1, 1024, 128, 4, 128,
+};
+#define CLASS_MIN_DIFF(c) class_min_diff[c]
 #endif
 
 
@@ -90,6 +64,65 @@
 #define ALIGNMENT 8
 #endif
 
+// The heap grows in multiples of GROW_SIZE bytes; any excess stays in the
+// top chunk for later requests.  Must be a multiple of ALIGNMENT.
+#ifndef GROW_SIZE
+#define GROW_SIZE ALIGNMENT
+#endif
+
+// Deferred coalescing: freed blocks of up to QUICK_MAX_SIZE bytes are
+// parked on LIFO quick lists keyed by exact size, still marked USED, and
+// only merged into the bins by consolidate().  This trades some
+// utilization for throughput on alloc/free ping-pong, so it is off (0)
+// unless tuned on.
+#ifndef QUICK_MAX_SIZE
+#define QUICK_MAX_SIZE 0
+#endif
+
+// consolidate() also runs once more than QUICK_LIMIT blocks are parked.
+#ifndef QUICK_LIMIT
+#define QUICK_LIMIT 64
+#endif
+
+// Where add_to_list puts a block within its bin: at the head (LIFO), at
+// the tail (FIFO), or in address order, which tends to keep consecutive
+// allocations together and fragment less at the cost of a walk.
+#define LIST_LIFO 0
+#define LIST_FIFO 1
+#define LIST_ADDRESS 2
+#ifndef LIST_POLICY
+#define LIST_POLICY LIST_LIFO
+#endif
+
+// Free blocks of at least LARGE_MIN_SIZE bytes are kept in a size-ordered
+// tree for best-fit instead of in the bins.  0 keeps everything in bins.
+#ifndef LARGE_MIN_SIZE
+#define LARGE_MIN_SIZE 1024
+#endif
+
+// When no trace class was chosen, adaptive mode learns from the requests
+// it sees instead of taking the last row, and re-learns every
+// ADAPT_PERIOD requests.  It derives the two thresholds, and it gives the
+// exact block sizes that took at least 1/HOT_SHARE of the recent requests
+// each, up to NUM_HOT of them, bins of their own.  Free blocks migrate
+// between those hot bins and the size_to_class bins as sizes turn hot or
+// cold.  Choosing pow2 over range for a workload is left to allocator.c,
+// by trace class or once per heap by the auto strategy.
+#ifndef ADAPTIVE
+#define ADAPTIVE 0
+#endif
+#ifndef ADAPT_PERIOD
+#define ADAPT_PERIOD 1024
+#endif
+#if ADAPTIVE
+#define NUM_HOT 8
+#else
+#define NUM_HOT 0
+#endif
+#ifndef HOT_SHARE
+#define HOT_SHARE 16
+#endif
+
 // Trace classes are numbered 0..10. Use default value of -1.
 #ifndef TRACE_CLASS
 #define TRACE_CLASS -1
@@ -97,17 +130,27 @@
 
 // Rounds up to the nearest multiple of ALIGNMENT.
 #define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
-// SIZE will set the size, accounting for the fact that the least
-// significant bit is actually keeping track of whether the block is free.
-#define SIZE(size) (size & ~1)
+// The low bits of a block's size word are flags: USED is set while the
+// block is allocated, PREV_USED while the block physically before it is.
+#define USED 1
+#define PREV_USED 2
+#define FLAGS (USED | PREV_USED)
+// SIZE strips the flag bits from a size word.
+#define SIZE(size) ((size) & ~FLAGS)
 
-// The size of a size_t in bits (approx).
-#define NUM_BINS 26
+// Blocks up to 2^25 bytes get their own size class; larger ones all share
+// the last bin.
+#define NUM_OCTAVES 26
+#define NUM_BINS NUM_CLASSES(NUM_OCTAVES)
 
+// Every block starts with its size word.  Allocated blocks carry nothing
+// else: the payload follows the size word directly.  Free blocks also hold
+// their list links in the payload and repeat their size in a footer, which
+// the block after them finds by checking its PREV_USED bit.
 struct free_list {
+  size_t size;
   struct free_list* next;
   struct free_list* prev;
-  size_t size;
 };
 
 typedef struct free_list Header;
@@ -117,93 +160,678 @@ struct footer {
 };
 typedef struct footer Footer;
 
-// The smallest aligned value for header, footer, and combined.
-#define HEADER_SIZE (ALIGN(sizeof(Header)))
+// Large free blocks hold tree links instead of list links.
+struct large_node {
+  size_t size;
+  struct large_node* left;
+  struct large_node* right;
+  struct large_node* parent;
+};
+
+typedef struct large_node Tree;
+
+// Overhead of an allocated block, and the size of a free block's footer.
+#define HEADER_SIZE (ALIGN(sizeof(size_t)))
 #define FOOTER_SIZE (ALIGN(sizeof(Footer)))
-#define TOTAL_EXTRA_SIZE HEADER_SIZE + FOOTER_SIZE
+// A free block must fit its size word, links and footer.
+#define MIN_BLOCK_SIZE (ALIGN(sizeof(Header) + sizeof(Footer)))
+// Routes a free block of the given size to the tree rather than the bins.
+#define IS_LARGE(size) (LARGE_MIN_SIZE && SIZE(size) >= LARGE_MIN_SIZE)
+
+_Static_assert(!LARGE_MIN_SIZE ||
+               LARGE_MIN_SIZE >= sizeof(Tree) + sizeof(Footer),
+               "LARGE_MIN_SIZE must fit a tree node and footer");
+
+// The trace class my_set_class chose, -1 for none.
+static int range_class = TRACE_CLASS;
+// The smallest block my_malloc hands out, and the surplus an allocated
+// block may keep rather than have it split off, for the current heap.
+static size_t min_alloc_size;
+static size_t min_diff;
+#define MIN_ALLOC_SIZE min_alloc_size
+#define SPLIT_SLACK min_diff
+
+// The array that acts as free list bins.  The NUM_HOT bins after the
+// size classes each hold the free blocks of one hot size.
+static Header* FreeList[NUM_BINS + NUM_HOT];
+#if LIST_POLICY == LIST_FIFO
+// The last block of each bin, for FIFO insertion.
+static Header* FreeTail[NUM_BINS + NUM_HOT];
+#endif
+// Root of the tree of large free blocks, ordered by size then address.
+static Tree* LargeRoot;
+
+// The prologue, which is heap_lo unless another strategy owns the heap
+// below it.
+static Header* heap_base;
+// Quick list i holds parked blocks of exactly i * ALIGNMENT bytes, linked
+// through their next field.
+#define NUM_QUICK (QUICK_MAX_SIZE / ALIGNMENT + 1)
+static Header* QuickList[NUM_QUICK];
+// Number of blocks parked across all quick lists.
+static size_t quick_count;
+
+// Build with -DQUICK_STATS to report the quick list hit rate at exit.
+#ifdef QUICK_STATS
+static size_t quick_hits, quick_misses, quick_consolidations;
+#define QUICK_STAT(counter) ((counter)++)
+
+__attribute__((destructor)) static void print_quick_stats(void) {
+  size_t lookups = quick_hits + quick_misses;
+  fprintf(stderr, "quick lists: %lu hits, %lu misses (%.1f%% hit rate), "
+          "%lu consolidations\n", quick_hits, quick_misses,
+          lookups ? 100.0 * quick_hits / lookups : 0.0, quick_consolidations);
+}
+#else
+#define QUICK_STAT(counter)
+#endif
+// Bit i is set iff FreeList[i] is non-empty, so the next usable bin
+// above a miss is a find-first-set over a few words.
+#define BINMAP_WORDS ((NUM_BINS + SIZE_T_BITS - 1) / SIZE_T_BITS)
+static size_t BinMap[BINMAP_WORDS];
+#define BINMAP_WORD(i) (BinMap[(i) / SIZE_T_BITS])
+#define BINMAP_BIT(i) ((size_t)1 << ((i) % SIZE_T_BITS))
+
+// Returns the size class bin of a block of the given size, i.e. its
+// log-linear size class.  Sizes beyond the last bin share it.
+static inline size_t class_bin(size_t size) {
+  // Necessary constraint on argument.
+  assert (SIZE(size) > 0);
+  size_t bin = size_to_class(SIZE(size));
+  return bin < NUM_BINS ? bin : NUM_BINS - 1;
+}
+
+#if ADAPTIVE
+// The block size each hot bin holds, 0 while it is unused.
+static size_t HotSize[NUM_HOT];
+static int num_hot;
+// Bit i is set iff a hot size falls in size class i, so that only those
+// classes need a look at HotSize.
+static size_t HotClassMap[BINMAP_WORDS];
+
+// Returns the hot bin of blocks of exactly size bytes in class bin, or
+// bin if size is not hot.
+static inline size_t hot_bin(size_t size, size_t bin) {
+  if (!(HotClassMap[bin / SIZE_T_BITS] & BINMAP_BIT(bin)))
+    return bin;
+  for (int h = 0; h < NUM_HOT; h++) {
+    if (HotSize[h] == size)
+      return NUM_BINS + h;
+  }
+  return bin;
+}
+
+// Returns the smallest free block of a hot size of at least aligned_size
+// bytes, or NULL.  Hot blocks are outside the ordered search by class.
+static inline Header* hot_fit(size_t aligned_size) {
+  Header* best = NULL;
+  for (int h = 0; num_hot && h < NUM_HOT; h++) {
+    Header* b = FreeList[NUM_BINS + h];
+    if (b && HotSize[h] >= aligned_size &&
+        (!best || HotSize[h] < SIZE(best->size)))
+      best = b;
+  }
+  return best;
+}
+#endif
+
+// Returns the FreeList bin of a block of the given size: its hot bin if
+// it is exactly a hot size, and its size class bin otherwise.
+static inline size_t bin_index(size_t size) {
+  size_t bin = class_bin(size);
+#if ADAPTIVE
+  bin = hot_bin(SIZE(size), bin);
+#endif
+  return bin;
+}
+
+#if ADAPTIVE
+// Set while the heap learns, i.e. when no class was chosen.
+static int adapting;
+// Request sizes seen, by power-of-two octave, and the reallocs that had to
+// grow their block and by how much in total.  Halved after every
+// recomputation so that older requests fade out.
+static size_t AdaptHist[NUM_OCTAVES];
+static size_t adapt_samples;
+static size_t adapt_grows;
+static size_t adapt_growth;
+
+// Counts of exact request sizes, hashed into HOT_SLOTS slots.  A size
+// that misses a taken slot only wears its count down, so a slot ends up
+// holding the size that dominates it.  A size with 1/HOT_SHARE of the
+// requests keeps its slot unless another equally common size shares it.
+#define HOT_SLOT_BITS 6
+#define HOT_SLOTS (1 << HOT_SLOT_BITS)
+static struct {
+  size_t size;
+  size_t count;
+} HotSeen[HOT_SLOTS];
+
+static inline void add_to_list(Header* cur);
+static void remove_from_list(Header* node);
+
+// Whether size is one of the n sizes in set.
+static inline int size_in(size_t size, const size_t* set, int n) {
+  for (int i = 0; i < n; i++) {
+    if (set[i] == size)
+      return 1;
+  }
+  return 0;
+}
+
+// Re-derives the hot sizes from the counts of the last window, total
+// requests in all, and moves the free blocks whose bin that changes.
+// Sizes that stay hot keep their bin.  A size that turns cold has its
+// blocks put back in their class bin, and one that turns hot has its
+// blocks pulled out of its class bin.  Blocks are removed under the old
+// mapping and added back under the new one.
+static void adapt_hot(size_t total) {
+  // The hot sizes, most common first, as the blocks my_malloc would give
+  // them.
+  size_t hot[NUM_HOT];
+  size_t hot_count[NUM_HOT];
+  int n = 0;
+  for (int i = 0; i < HOT_SLOTS; i++) {
+    size_t count = HotSeen[i].count;
+    size_t block = HotSeen[i].size > min_alloc_size ? HotSeen[i].size :
+                                                      min_alloc_size;
+    if (!count || count * HOT_SHARE < total ||
+        (LARGE_MIN_SIZE && block >= LARGE_MIN_SIZE))
+      continue;
+    int j = n < NUM_HOT ? n++ : NUM_HOT;
+    while (j > 0 && hot_count[j - 1] < count) {
+      if (j < NUM_HOT) {
+        hot[j] = hot[j - 1];
+        hot_count[j] = hot_count[j - 1];
+      }
+      j--;
+    }
+    if (j < NUM_HOT) {
+      hot[j] = block;
+      hot_count[j] = count;
+    }
+  }
+  // Sizes below min_alloc_size all become the same block.
+  int fresh = 0;
+  for (int i = 0; i < n; i++) {
+    if (!size_in(hot[i], hot, fresh))
+      hot[fresh++] = hot[i];
+  }
+
+  Header* moved = NULL;
+  for (int h = 0; h < NUM_HOT; h++) {
+    if (!HotSize[h] || size_in(HotSize[h], hot, fresh))
+      continue;
+    Header* b;
+    while ((b = FreeList[NUM_BINS + h])) {
+      remove_from_list(b);
+      b->next = moved;
+      moved = b;
+    }
+    HotSize[h] = 0;
+    num_hot--;
+  }
+  for (int i = 0; i < fresh; i++) {
+    if (size_in(hot[i], HotSize, NUM_HOT))
+      continue;
+    Header* b = FreeList[class_bin(hot[i])];
+    while (b) {
+      Header* next = b->next;
+      if (SIZE(b->size) == hot[i]) {
+        remove_from_list(b);
+        b->next = moved;
+        moved = b;
+      }
+      b = next;
+    }
+    int h = 0;
+    while (HotSize[h])
+      h++;
+    HotSize[h] = hot[i];
+    num_hot++;
+  }
+
+  for (int i = 0; i < BINMAP_WORDS; i++)
+    HotClassMap[i] = 0;
+  for (int h = 0; h < NUM_HOT; h++) {
+    if (HotSize[h]) {
+      size_t bin = class_bin(HotSize[h]);
+      HotClassMap[bin / SIZE_T_BITS] |= BINMAP_BIT(bin);
+    }
+  }
+  while (moved) {
+    Header* next = moved->next;
+    add_to_list(moved);
+    moved = next;
+  }
+}
+
+// Re-derives the thresholds from the samples.  Requests below the first
+// octave holding at least 1/16 of the samples are rare, so they are
+// rounded up to that octave's smallest size, where their blocks can later
+// be reused by the common requests.  If at least 1/16 of the requests were
+// growing reallocs, blocks keep up to the average growth as slack so the
+// next realloc can grow in place.  Then the hot sizes follow.
+static void adapt() {
+  size_t total = 0;
+  for (int k = 0; k < NUM_OCTAVES; k++)
+    total += AdaptHist[k];
+
+  int hot = 0;
+  while (hot < NUM_OCTAVES - 1 && AdaptHist[hot] * 16 < total)
+    hot++;
+  size_t floor = hot ? ALIGN(((size_t)1 << (hot - 1)) + 1) : 0;
+  min_alloc_size = floor > MIN_BLOCK_SIZE ? floor : MIN_BLOCK_SIZE;
+
+  if (adapt_grows * 16 >= total)
+    min_diff = ALIGN(adapt_growth / adapt_grows);
+  else
+    min_diff = 0;
+
+  adapt_hot(total);
+
+  for (int k = 0; k < NUM_OCTAVES; k++)
+    AdaptHist[k] /= 2;
+  for (int i = 0; i < HOT_SLOTS; i++)
+    HotSeen[i].count /= 2;
+  adapt_grows /= 2;
+  adapt_growth /= 2;
+  adapt_samples = 0;
+}
+
+// Records a request for an aligned_size block.
+static inline void adapt_sample(size_t aligned_size) {
+  size_t k = size_to_bin(aligned_size);
+  AdaptHist[k < NUM_OCTAVES ? k : NUM_OCTAVES - 1]++;
+  size_t slot = (aligned_size / ALIGNMENT * 0x9E3779B97F4A7C15ULL) >>
+                (64 - HOT_SLOT_BITS);
+  if (HotSeen[slot].size == aligned_size) {
+    HotSeen[slot].count++;
+  } else if (!HotSeen[slot].count) {
+    HotSeen[slot].size = aligned_size;
+    HotSeen[slot].count = 1;
+  } else {
+    HotSeen[slot].count--;
+  }
+  if (++adapt_samples == ADAPT_PERIOD)
+    adapt();
+}
+#define ADAPT_SAMPLE(size) \
+  do { if (adapting) adapt_sample(size); } while (0)
+#else
+#define ADAPT_SAMPLE(size)
+#endif
+
+// The large block tree is a treap: a binary search tree on (size, address)
+// whose nodes are also heap-ordered on a priority hashed from the address,
+// which keeps its expected depth logarithmic without storing a balance
+// field.
+
+// Orders tree nodes by size, then address.
+static inline int tree_less(Tree* a, Tree* b) {
+  return SIZE(a->size) < SIZE(b->size) ||
+         (SIZE(a->size) == SIZE(b->size) && a < b);
+}
+
+static inline uint64_t tree_priority(Tree* x) {
+  return ((uintptr_t)x >> 3) * 0x9E3779B97F4A7C15ULL;
+}
+
+// Rotates x above its parent.
+static inline void tree_rotate_up(Tree* x) {
+  Tree* p = x->parent;
+  Tree* g = p->parent;
+  if (p->left == x) {
+    p->left = x->right;
+    if (x->right)
+      x->right->parent = p;
+    x->right = p;
+  } else {
+    p->right = x->left;
+    if (x->left)
+      x->left->parent = p;
+    x->left = p;
+  }
+  p->parent = x;
+  x->parent = g;
+  if (!g)
+    LargeRoot = x;
+  else if (g->left == p)
+    g->left = x;
+  else
+    g->right = x;
+}
+
+static inline void tree_insert(Tree* x) {
+  Tree* p = NULL;
+  Tree** link = &LargeRoot;
+  while (*link) {
+    p = *link;
+    link = tree_less(x, p) ? &p->left : &p->right;
+  }
+  *link = x;
+  x->parent = p;
+  x->left = NULL;
+  x->right = NULL;
+  while (x->parent && tree_priority(x) > tree_priority(x->parent))
+    tree_rotate_up(x);
+}
 
-// The array that acts as free list bins.
-Header* FreeList[NUM_BINS];
-// The constant heap-lo, held as a global variable.
-void* heap_lo;
+static inline void tree_remove(Tree* x) {
+  // Rotate x down to a leaf, keeping the priority order, then cut it off.
+  while (x->left || x->right) {
+    Tree* c;
+    if (!x->left)
+      c = x->right;
+    else if (!x->right)
+      c = x->left;
+    else
+      c = tree_priority(x->left) > tree_priority(x->right) ? x->left : x->right;
+    tree_rotate_up(c);
+  }
+  if (!x->parent)
+    LargeRoot = NULL;
+  else if (x->parent->left == x)
+    x->parent->left = NULL;
+  else
+    x->parent->right = NULL;
+}
+
+// Returns the smallest block of at least aligned_size bytes, or NULL.
+static inline Tree* tree_best_fit(size_t aligned_size) {
+  Tree* best = NULL;
+  Tree* cur = LargeRoot;
+  while (cur) {
+    if (SIZE(cur->size) >= aligned_size) {
+      best = cur;
+      cur = cur->left;
+    } else {
+      cur = cur->right;
+    }
+  }
+  return best;
+}
+
+// Checks order, priorities, links and sizes below x.
+static int check_tree(Tree* x) {
+  if (!IS_LARGE(x->size) || (x->size & USED))
+    return -1;
+  if (x->left && (x->left->parent != x || !tree_less(x->left, x) ||
+                  tree_priority(x->left) > tree_priority(x) ||
+                  check_tree(x->left) < 0))
+    return -1;
+  if (x->right && (x->right->parent != x || !tree_less(x, x->right) ||
+                   tree_priority(x->right) > tree_priority(x) ||
+                   check_tree(x->right) < 0))
+    return -1;
+  return 0;
+}
 
 // check - This checks our invariant that the size_t header before every
-// block points to either the beginning of the next block, or the end of the
-// heap.
+// block points to either the beginning of the next block, or the epilogue
+// at the end of the heap.
 // It also checks the validity of items in the FreeList bins.
 int my_check() {
   char *p;
-  char *lo = (char*)mem_heap_lo();
+  char *lo = (char*)heap_base;
   char *hi = (char*)mem_heap_hi() + 1;
   size_t size = 0;
 
-  p = lo;
+  if (SIZE(((Header*)lo)->size) != HEADER_SIZE ||
+      !(((Header*)lo)->size & USED)) {
+    printf("Bad prologue at %p!\n", lo);
+    return -1;
+  }
+
+  size_t prev_used = PREV_USED;
+  p = lo + HEADER_SIZE;
   while (lo <= p && p < hi) {
     Header *cur = (Header*)p;
     size = ALIGN(SIZE(cur->size));
+    if ((cur->size & PREV_USED) != prev_used) {
+      printf("Block %p has a stale PREV_USED bit\n", cur);
+      return -1;
+    }
+    if (!(cur->size & USED) && size &&
+        ((Footer*)(p + size - FOOTER_SIZE))->size != size) {
+      printf("Free block %p has a bad footer\n", cur);
+      return -1;
+    }
+    // The zero-sized epilogue ends the walk.
+    if (!size)
+      break;
+    prev_used = (cur->size & USED) ? PREV_USED : 0;
     p += size;
   }
 
-  if (p != hi) {
-    printf("Bad headers did not end at heap_hi!\n");
+  if (p != hi - HEADER_SIZE || !(((Header*)p)->size & USED)) {
+    printf("Bad headers did not end at the epilogue before heap_hi!\n");
     printf("heap_lo: %p, heap_hi: %p, size: %lu, p: %p\n", lo, hi, size, p);
     return -1;
   }
 
-  for (int i=0; i < NUM_BINS; i++) {
+  if (LargeRoot && (LargeRoot->parent || check_tree(LargeRoot) < 0)) {
+    printf("The large block tree is broken\n");
+    return -1;
+  }
+
+  size_t parked = 0;
+  for (int i = 0; i < NUM_QUICK; i++) {
+    for (Header *q = QuickList[i]; q; q = q->next) {
+      if (!(q->size & USED) || SIZE(q->size) != i * ALIGNMENT) {
+        printf("Quick list %d had a bad block %p\n", i, q);
+        return -1;
+      }
+      parked++;
+    }
+  }
+  if (parked != quick_count) {
+    printf("quick_count is %lu but %lu blocks are parked\n",
+           quick_count, parked);
+    return -1;
+  }
+
+  for (int i=0; i < NUM_BINS + NUM_HOT; i++) {
     Header *this = FreeList[i];
+    // Hot bins are not in BinMap.
+    if (i < NUM_BINS && !this != !(BINMAP_WORD(i) & BINMAP_BIT(i))) {
+      printf("BinMap bit %d does not match FreeList[%d]\n", i, i);
+      return -1;
+    }
     while (this) {
-      if (SIZE(this->size) <= (1 << (i-1)) || SIZE(this->size) > (1 << i)) {
+      if ((this->size & USED) || bin_index(this->size) != i) {
         printf("You seriously suck. Bin %d had a fucked up node\n", i);
         return -1;
       }
+#if LIST_POLICY == LIST_ADDRESS
+      if (this->next && this->next < this) {
+        printf("Bin %d is out of address order\n", i);
+        return -1;
+      }
+#elif LIST_POLICY == LIST_FIFO
+      if (!this->next && FreeTail[i] != this) {
+        printf("FreeTail[%d] is not the last node\n", i);
+        return -1;
+      }
+#endif
       this = this->next;
     }
   }
   return 0;
 }
 
+// Returns the block physically after b.
+static inline Header* next_block(Header* b) {
+  return (Header*)((char*)b + SIZE(b->size));
+}
+
+// Tunes the thresholds of heaps that my_init lays down from now on for
+// trace_class, or learns them if it is -1.
+void my_set_class(int trace_class) {
+  range_class = trace_class;
+}
+
 // init - Initialize the malloc package.  Called once before any other
-// calls are made.  Since this is a very simple implementation, we just
-// return success after assigning the bins as NULL.
+// calls are made.  Empties the bins and lays down the prologue and
+// epilogue: permanently allocated sentinels that stop coalesce() from
+// walking off either end of the heap.
 int my_init() {
-  for(int i = 0; i < NUM_BINS; i++)
+  for(int i = 0; i < NUM_BINS + NUM_HOT; i++)
     FreeList[i] = NULL;
-  heap_lo = my_heap_lo();
+#if LIST_POLICY == LIST_FIFO
+  for(int i = 0; i < NUM_BINS + NUM_HOT; i++)
+    FreeTail[i] = NULL;
+#endif
+  for (int i = 0; i < BINMAP_WORDS; i++)
+    BinMap[i] = 0;
+  for (int i = 0; i < NUM_QUICK; i++)
+    QuickList[i] = NULL;
+  quick_count = 0;
+  LargeRoot = NULL;
+  int row = range_class >= 0 && range_class < NUM_TUNED_CLASSES ?
+            range_class : NUM_TUNED_CLASSES;
+  min_alloc_size = CLASS_MIN_SIZE(row) > MIN_BLOCK_SIZE ?
+                   CLASS_MIN_SIZE(row) : MIN_BLOCK_SIZE;
+  min_diff = CLASS_MIN_DIFF(row);
+#if ADAPTIVE
+  // Start from the thresholds that never round up or keep slack.
+  adapting = range_class < 0;
+  if (adapting) {
+    min_alloc_size = MIN_BLOCK_SIZE;
+    min_diff = 0;
+  }
+  for (int i = 0; i < NUM_OCTAVES; i++)
+    AdaptHist[i] = 0;
+  adapt_samples = adapt_grows = adapt_growth = 0;
+  memset(HotSeen, 0, sizeof(HotSeen));
+  memset(HotSize, 0, sizeof(HotSize));
+  memset(HotClassMap, 0, sizeof(HotClassMap));
+  num_hot = 0;
+#endif
+  Header* prologue = mem_sbrk(2 * HEADER_SIZE);
+  if (prologue == (void *)-1)
+    return -1;
+  prologue->size = HEADER_SIZE | USED | PREV_USED;
+  heap_base = prologue;
+  // The epilogue is a zero-sized block whose PREV_USED bit tracks the last
+  // real block.  Heap growth turns it into the new block's header.
+  next_block(prologue)->size = USED | PREV_USED;
   return 0;
 }
 
-// Returns the upper bound of the log in O(lg N) for N-bit num.
-// Bit hack attained from Bit Twiddling Hacks page.
-static inline size_t log_upper(size_t val) {
-  val = SIZE(val);
-  const unsigned int b[] = {0x2, 0xC, 0xF0, 0xFF00, 0xFFFF0000};
-  const unsigned int S[] = {1, 2, 4, 8, 16};
-  size_t r = 0;
-  // Necessary constraint on argument.
-  assert (val > 0);
-  val--;
-  for (int i = 4; i >= 0; i--) {
-    if (val & b[i]) {
-      val >>= S[i];
-      r |= S[i];
-    }
-  }
-  return r+1;
+// Sets or clears the PREV_USED bit of b, which may be allocated.  In a
+// thread-safe build my_usable_size reads it without the lock, so the bit
+// is flipped atomically there.
+static inline void set_prev_used(Header* b, int used) {
+#if THREAD_SAFE
+  if (used)
+    __atomic_fetch_or(&b->size, PREV_USED, __ATOMIC_RELAXED);
+  else
+    __atomic_fetch_and(&b->size, ~(size_t)PREV_USED, __ATOMIC_RELAXED);
+#else
+  if (used)
+    b->size |= PREV_USED;
+  else
+    b->size &= ~PREV_USED;
+#endif
+}
+
+// Marks b allocated.
+static inline void mark_used(Header* b) {
+  b->size |= USED;
+  set_prev_used(next_block(b), 1);
 }
 
-// add a block to freeing list
+// Marks b free and writes its footer.
+static inline void mark_free(Header* b) {
+  b->size &= ~USED;
+  ((Footer*)((char*)b + SIZE(b->size) - FOOTER_SIZE))->size = SIZE(b->size);
+  set_prev_used(next_block(b), 0);
+}
+
+// add a block to freeing list, or to the tree if it is large
 static inline void add_to_list(Header* cur) {
-    size_t index = log_upper(cur->size);
-    Header* c = FreeList[index];
+    if (IS_LARGE(cur->size)) {
+      tree_insert((Tree*)cur);
+      return;
+    }
+    size_t index = bin_index(cur->size);
+
+    // cur goes right after prev, or at the head if prev is NULL.
+    Header* prev = NULL;
+#if LIST_POLICY == LIST_FIFO
+    prev = FreeTail[index];
+#elif LIST_POLICY == LIST_ADDRESS
+    for (Header* c = FreeList[index]; c && c < cur; c = c->next)
+      prev = c;
+#endif
+    Header* c = prev ? prev->next : FreeList[index];
 
     cur->next = c;
     if (c)
       c->prev = cur;
-    FreeList[index] = cur;
-    cur->prev = NULL;
+    if (prev)
+      prev->next = cur;
+    else
+      FreeList[index] = cur;
+    cur->prev = prev;
+#if LIST_POLICY == LIST_FIFO
+    if (!c)
+      FreeTail[index] = cur;
+#endif
+    if (index < NUM_BINS)
+      BINMAP_WORD(index) |= BINMAP_BIT(index);
+}
 
-    cur->size &= ~1;
+// Removes a node from a list, or from the tree if it is large.
+static void remove_from_list(Header* node){
+  if (IS_LARGE(node->size)) {
+    tree_remove((Tree*)node);
+    return;
+  }
+  size_t ind = bin_index(node->size);
+#if LIST_POLICY == LIST_FIFO
+  if (!node->next)
+    FreeTail[ind] = node->prev;
+#endif
+  if (!node->prev){
+    FreeList[ind] = node->next;
+    if (node->next)
+      node->next->prev = NULL;
+    else if (ind < NUM_BINS)
+      BINMAP_WORD(ind) &= ~BINMAP_BIT(ind);
+  }
+  else{
+    node->prev->next = node->next;
+    if (node->next)
+      node->next->prev = node->prev;
+  }
+  node->prev = NULL;
+  node->next = NULL;
+}
+
+// Returns the first non-empty bin at or above index, or NUM_BINS if
+// there is none.
+static inline size_t next_bin(size_t index) {
+  if (index >= NUM_BINS)
+    return NUM_BINS;
+  size_t word = index / SIZE_T_BITS;
+  size_t mask = BinMap[word] & (~(size_t)0 << (index % SIZE_T_BITS));
+  while (!mask) {
+    if (++word == BINMAP_WORDS)
+      return NUM_BINS;
+    mask = BinMap[word];
+  }
+  return word * SIZE_T_BITS + __builtin_ctzl(mask);
+}
+
+// First-fit walk of a single bin; NULL if no block there holds
+// aligned_size.
+static inline Header* bin_first_fit(size_t bin, size_t aligned_size) {
+  Header *cur = FreeList[bin];
+  while (cur && SIZE(cur->size) < aligned_size)
+    cur = cur->next;
+  return cur;
 }
 
 // When binning by ranges with variable size allocated blocks, 
@@ -212,15 +840,29 @@ static inline void add_to_list(Header* cur) {
 // This is to allocate exactly what the user asked for and conserve
 // the extra in the free list bins.
 
+static void free_block(Header* b);
+
 static inline void chunk (Header* cur, size_t aligned_size){
     Header* chunk = (Header*)((char*)cur + aligned_size);
-    chunk->size = SIZE(cur->size) - aligned_size;
-    cur->size = aligned_size;
-    Footer* chunk_f = (Footer*)((char*)chunk + chunk->size - FOOTER_SIZE);
-    chunk_f->size = chunk->size;
-    Footer* cur_f = (Footer*)((char*)cur + aligned_size - FOOTER_SIZE);
-    cur_f->size = aligned_size;
-    add_to_list(chunk);
+    chunk->size = (SIZE(cur->size) - aligned_size) | USED | PREV_USED;
+    cur->size = aligned_size | (cur->size & FLAGS);
+    free_block(chunk);
+}
+
+// Trims an allocated block down to aligned_size if the surplus is worth
+// returning to the bins.
+static inline void trim(Header* b, size_t aligned_size) {
+  if (SIZE(b->size) - aligned_size > MIN_BLOCK_SIZE + SPLIT_SLACK)
+    chunk(b, aligned_size);
+}
+
+// The top chunk is the free block, if any, directly before the
+// epilogue.  It is the only block that can grow without moving.
+static inline Header* top_chunk(Header* epilogue) {
+  if (epilogue->size & PREV_USED)
+    return NULL;
+  Footer* f = (Footer*)((char*)epilogue - FOOTER_SIZE);
+  return (Header*)((char*)epilogue - f->size);
 }
 
 static inline size_t max (size_t x, size_t y){
@@ -230,6 +872,45 @@ static inline size_t min (size_t x, size_t y){
   return y ^ ((x ^ y) & -(x < y));
 }
 
+// Finds a free block of at least aligned_size bytes in the bins, or NULL.
+static inline Header* find_fit(size_t aligned_size) {
+  // Only the tree holds blocks this big, and it gives the best fit.
+  if (IS_LARGE(aligned_size))
+    return (Header*)tree_best_fit(aligned_size);
+
+  size_t bin = bin_index(aligned_size);
+
+  // The head of the request's own bin is worth one comparison.
+  Header *c = FreeList[bin];
+  if (!c || SIZE(c->size) < aligned_size) {
+    // Classes are ordered, so every block in a bin above the class of
+    // aligned_size - 1 is large enough and the head can be taken as is.
+    // Sizes past the last class share a bin and still need a walk.
+    size_t fit = min(size_to_class(aligned_size - 1) + 1, NUM_BINS - 1);
+    size_t index = next_bin(fit);
+    if (index < NUM_BINS - 1)
+      c = FreeList[index];
+    else if (index == NUM_BINS - 1)
+      c = bin_first_fit(index, aligned_size);
+    else
+      c = NULL;
+    // Before growing the heap, fall back to a first-fit walk of the
+    // request's own class bin, and to the hot bins.
+    if (!c)
+      c = bin_first_fit(class_bin(aligned_size), aligned_size);
+#if ADAPTIVE
+    if (!c)
+      c = hot_fit(aligned_size);
+#endif
+    // Any large block fits; the tree gives the smallest.
+    if (!c && LargeRoot)
+      c = (Header*)tree_best_fit(aligned_size);
+  }
+  return c;
+}
+
+static void consolidate();
+
 //  malloc - Allocate a block by incrementing the brk pointer.
 //  Always allocate a block whose size is a multiple of the alignment.
 void * my_malloc(size_t size) {
@@ -237,157 +918,135 @@ void * my_malloc(size_t size) {
   // Find the upper bound lg of size to find corresponding bin
   // If bin is not null, we allocate
 
-  size += TOTAL_EXTRA_SIZE;
-  size_t aligned_size = max(ALIGN(size), MIN_SIZE);
-  size_t lg_size = log_upper(aligned_size);
-  size_t index = lg_size + 1;
-
-  Header *prev, *cur;
-  prev = NULL;
-  cur = FreeList[lg_size];
+  size += HEADER_SIZE;
+  ADAPT_SAMPLE(ALIGN(size));
+  size_t aligned_size = max(ALIGN(size), MIN_ALLOC_SIZE);
+  // A parked block of exactly the right size needs no bin work at all.
+  if (aligned_size <= QUICK_MAX_SIZE) {
+    Header *q = QuickList[aligned_size / ALIGNMENT];
+    if (q) {
+      QUICK_STAT(quick_hits);
+      QuickList[aligned_size / ALIGNMENT] = q->next;
+      quick_count--;
+      return (void*)((char*)q + HEADER_SIZE);
+    }
+    QUICK_STAT(quick_misses);
+  }
 
-  while (cur && cur->size < aligned_size){
-    prev = cur;
-    cur = cur->next;
+  Header *c = find_fit(aligned_size);
+  // Parked blocks may merge into something that fits; try that before
+  // growing the heap.
+  if (!c && quick_count) {
+    consolidate();
+    c = find_fit(aligned_size);
   }
-  if (cur){
-    if(!prev){
-      FreeList[lg_size] = cur->next;
-      if (cur->next)
-        cur->next->prev = NULL;
-    }
-    else {
-      prev->next = cur->next;
-      if (cur->next)
-        cur->next->prev = prev;
-    }
-    cur->prev = NULL;
-    cur->next = NULL;
-    cur->size |= 1;
-    return (void*)((char*)cur + HEADER_SIZE);
-  }
-
-  while (index < NUM_BINS){
-    if (FreeList[index]){
-      Header* c = FreeList[index];
-
-      FreeList[index] = c->next;
-      if (c->next)
-        c->next->prev = NULL;
-      c->prev = NULL;
-      c->next = NULL;
-      
-      // If the size of the chunk we wish to allocate is much bigger
-      // than the requested size, we split into two chunks, freeing the 
-      // latter chunk and returning the former.
-      if (SIZE(c->size) - aligned_size > TOTAL_EXTRA_SIZE + MIN_DIFF)
-        chunk(c, aligned_size);
-      
-      c->size |= 1;
-
-      return (void*)((char*)c + HEADER_SIZE);
-    }
-    index++;
+
+  if (c){
+    remove_from_list(c);
+
+    // If the size of the chunk we wish to allocate is much bigger
+    // than the requested size, we split into two chunks, freeing the 
+    // latter chunk and returning the former.
+    mark_used(c);
+    trim(c, aligned_size);
+
+    return (void*)((char*)c + HEADER_SIZE);
   }
 
-  // We allocate a little bit of extra memory so that we can store the
-  // size of the block we've allocated.  Take a look at realloc to see
-  // one example of a place where this can come in handy.
+  // Nothing fits, so grow the heap.  If the top chunk is free it only
+  // needs to be extended by the shortfall.
+  Header* epilogue = (Header*)((char*)mem_heap_hi() + 1 - HEADER_SIZE);
+  Header* top = top_chunk(epilogue);
+  size_t top_size = top ? SIZE(top->size) : 0;
+  size_t grow = (aligned_size - top_size + GROW_SIZE - 1) / GROW_SIZE * GROW_SIZE;
 
   // Expands the heap by the given number of bytes and returns a pointer to
   // the newly-allocated area.  This is a slow call, so you will want to
   // make sure you don't wind up calling it on every malloc.
-  void *p = mem_sbrk(aligned_size);
-
-  if (p == (void *)-1) {
+  if (mem_sbrk(grow) == (void *)-1) {
     // Whoops, an error of some sort occurred.  We return NULL to let
     // the client code know that we weren't able to allocate memory.
     return NULL;
-  } else {
-    // We store the size of the block we've allocated in the first
-    // HEADER_SIZE bytes.
-    ((Header*)p)->next = NULL;
-    ((Header*)p)->prev = NULL;
-    ((Header*)p)->size = aligned_size + 1;
-    ((Footer*)((char*)p + aligned_size - FOOTER_SIZE))->size = aligned_size;
-    // Then, we return a pointer to the rest of the block of memory,
-    // which is at least size bytes long.  We have to cast to uint8_t
-    // before we try any pointer arithmetic because voids have no size
-    // and so the compiler doesn't know how far to move the pointer.
-    // Since a uint8_t is always one byte, adding HEADER_SIZE after
-    // casting advances the pointer by HEADER_SIZE bytes.
-    return (void *)((char *)p + HEADER_SIZE);
-  }
-}
-
-// Removes a node from a list.
-void remove_from_list(Header* node){
-  size_t ind = log_upper(node->size);
-  if (!node->prev){
-    FreeList[ind] = node->next;
-    if (node->next)
-      node->next->prev = NULL;
   }
-  else{
-    node->prev->next = node->next;
-    if (node->next)
-      node->next->prev = node->prev;
-  }
-  node->prev = NULL;
-  node->next = NULL;
+
+  // Either the top chunk or the old epilogue becomes the new block's
+  // header, keeping its PREV_USED bit, and a new epilogue goes at the end.
+  if (top)
+    remove_from_list(top);
+  else
+    top = epilogue;
+  top->size = (top_size + grow) | (top->size & PREV_USED);
+  next_block(top)->size = USED;
+  mark_used(top);
+  // Anything past aligned_size is left as the new top chunk.
+  trim(top, aligned_size);
+  return (void *)((char *)top + HEADER_SIZE);
 }
 
 // takes a mid block, checks left and right to see if coalescing is possible.
-Header* coalesce (Header * mid){
-  size_t total = mid->size;
-  Header* right = (Header*)((char*)mid + mid->size);
-  // Check if block directly after is free.
-  if ((void*)right != my_heap_hi()+1){
-    // Recall that the free bit is stored in the least significant bit of size.
-    if (!(right->size & 1)){
-      remove_from_list(right);
-      total += right->size;
-    }
+static Header* coalesce (Header * mid){
+  size_t total = SIZE(mid->size);
+  Header* right = (Header*)((char*)mid + total);
+  // Check if block directly after is free.  The epilogue never is.
+  if (!(right->size & USED)){
+    remove_from_list(right);
+    total += SIZE(right->size);
+  }
+  // Check if block directly before is free; only then is there a footer
+  // in front of mid.  The prologue keeps the first block's bit set.
+  if (!(mid->size & PREV_USED)){
+    Footer* left_f = (Footer*)((char*)mid - FOOTER_SIZE);
+    Header* left = (Header*)((char*)mid - left_f->size);
+    remove_from_list(left);
+    total += SIZE(left->size);
+    mid = left;
   }
-  // Check if block directly before is free.
-  if ((void*)mid == heap_lo){
-    mid->size = total;
-    ((Footer*)((char*)mid + mid->size - FOOTER_SIZE))->size = total;
-    return mid;
-  }
-  // Access relevant header and footer.
-  Footer* left_f = (Footer*)((char*)mid - FOOTER_SIZE);
-  Header* left = (Header*)((char*)mid - left_f->size);
-  // Check if the block is not free.
-  if (left->size & 1){
-    mid->size = total;
-    ((Footer*)((char*)mid + mid->size - FOOTER_SIZE))->size = total;
-    return mid;
-  }
-  remove_from_list(left);
-  total += left->size;
-  mid = left;
-  mid->size = total;
-  ((Footer*)((char*)mid + mid->size - FOOTER_SIZE))->size = total;
+  mid->size = total | (mid->size & FLAGS);
   return mid;
 }
 
-// free - Find the appropriate bin for a freed
-// element by accessing its header and finding
-// its size.
-// Places size in bin k such that 2^(k-1) < size <= 2^k.
+// Coalesces an allocated block with its free neighbours and bins the
+// result.
+static void free_block(Header* b) {
+  b = coalesce(b);
+  mark_free(b);
+  add_to_list(b);
+}
+
+// Merges every parked block into the bins.
+static void consolidate() {
+  QUICK_STAT(quick_consolidations);
+  for (int i = 0; i < NUM_QUICK; i++) {
+    Header *q = QuickList[i];
+    QuickList[i] = NULL;
+    while (q) {
+      Header *next = q->next;
+      free_block(q);
+      q = next;
+    }
+  }
+  quick_count = 0;
+}
+
+// free - Parks small blocks on their quick list; everything else is
+// coalesced and placed in the appropriate bin by its size.
 void my_free(void *ptr) {
-  Header* cur = (Header*)((char*)ptr - HEADER_SIZE);
-  cur->size = SIZE(cur->size);
-  cur = coalesce(cur);
-  cur->size = SIZE(cur->size);
-  add_to_list(cur);
+  Header* b = (Header*)((char*)ptr - HEADER_SIZE);
+  size_t size = SIZE(b->size);
+  if (size <= QUICK_MAX_SIZE) {
+    b->next = QuickList[size / ALIGNMENT];
+    QuickList[size / ALIGNMENT] = b;
+    if (++quick_count > QUICK_LIMIT)
+      consolidate();
+    return;
+  }
+  free_block(b);
 }
 
-// realloc - Implemented simply in terms of malloc and free
+// realloc - Resizes in place whenever the block or its free neighbours
+// can hold the new size, and falls back to malloc, copy and free.
 void * my_realloc(void *ptr, size_t size) {
   void *newptr;
-  size_t copy_size;
 
   if(!ptr)
     return my_malloc(size);
@@ -397,49 +1056,79 @@ void * my_realloc(void *ptr, size_t size) {
     return NULL;
   }
 
-
-  size_t aligned_size = ALIGN(size + HEADER_SIZE);
+  size_t aligned_size = max(ALIGN(size + HEADER_SIZE), MIN_BLOCK_SIZE);
   // Here is the header we are working with.
   Header* mem = (Header*)((char*)ptr - HEADER_SIZE);
-  copy_size = min(SIZE(mem->size), aligned_size) - HEADER_SIZE;
-
+  size_t old_size = SIZE(mem->size);
+#if ADAPTIVE
+  if (aligned_size > old_size) {
+    adapt_grows++;
+    adapt_growth += aligned_size - old_size;
+  }
+#endif
+  ADAPT_SAMPLE(aligned_size);
 
-  // If the new block is smaller than the old one, we have to stop copying
-  // early so that we don't write off the end of the new block of memory.
-  
-  if (aligned_size + MIN_DIFF < copy_size){
-    chunk(mem, aligned_size);
+  // Shrinking, or growing within slack we already own.
+  if (old_size >= aligned_size){
+    trim(mem, aligned_size);
     return ptr;
   }
 
-  // Didn't shave off chunk, but still should return ptr
-  // since new block smaller than old one.
-  if (SIZE(mem->size) >= aligned_size)
+  // Free space directly to the right of mem.
+  Header* right = next_block(mem);
+  size_t right_size = 0;
+  if (!(right->size & USED))
+    right_size = SIZE(right->size);
+
+  // Grow into the right neighbour without copying.
+  if (old_size + right_size >= aligned_size){
+    remove_from_list(right);
+    mem->size = (old_size + right_size) | (mem->size & FLAGS);
+    mark_used(mem);
+    trim(mem, aligned_size);
     return ptr;
-  
-  // for consecutive, increasing reallocs
-  if ((char*)mem + SIZE(mem->size) == my_heap_hi()+1)
-  {
-    mem_sbrk(aligned_size - SIZE(mem->size));
-    mem->size = aligned_size + 1;
-    Footer* f = (Footer*)((char*)mem + aligned_size - FOOTER_SIZE);
-    f->size = aligned_size;
+  }
+
+  // for consecutive, increasing reallocs: mem (plus a free right
+  // neighbour) is followed by the epilogue, so sbrk only the shortfall.
+  Header* end = (Header*)((char*)mem + old_size + right_size);
+  if (!SIZE(end->size)){
+    if (mem_sbrk(aligned_size - old_size - right_size) == (void *)-1)
+      return NULL;
+    if (right_size)
+      remove_from_list(right);
+    mem->size = aligned_size | (mem->size & FLAGS);
+    next_block(mem)->size = USED | PREV_USED;
     return ptr;
   }
-  
+
+  // Slide down into a free left neighbour.  The old payload may overlap
+  // the new one, hence memmove.
+  if (!(mem->size & PREV_USED)){
+    Footer* left_f = (Footer*)((char*)mem - FOOTER_SIZE);
+    size_t left_size = left_f->size;
+    if (left_size + old_size + right_size >= aligned_size){
+      Header* left = (Header*)((char*)mem - left_size);
+      remove_from_list(left);
+      if (right_size)
+        remove_from_list(right);
+      newptr = (char*)left + HEADER_SIZE;
+      memmove(newptr, ptr, old_size - HEADER_SIZE);
+      left->size = (left_size + old_size + right_size) | (left->size & FLAGS);
+      mark_used(left);
+      trim(left, aligned_size);
+      return newptr;
+    }
+  }
+
   // Allocate a new chunk of memory, and fail if that allocation fails.
   newptr = my_malloc(size);
   if (NULL == newptr)
     return NULL;
 
-  // Get the size of the old block of memory.  Take a peek at my_malloc(),
-  // where we stashed this in the HEADER_SIZE bytes directly before the
-  // address we returned.  Now we can back up by that many bytes and read
-  // the size by pulling it from the free list header.
-
   // This is a standard library call that performs a simple memory copy.
-  // We only want to copy the original size of mem so that's why we saved it.
-  memcpy(newptr, ptr, copy_size);
+  // The new block is larger, so the whole old payload fits.
+  memcpy(newptr, ptr, old_size - HEADER_SIZE);
 
   // Release the old block.
   my_free(ptr);
@@ -448,6 +1137,39 @@ void * my_realloc(void *ptr, size_t size) {
   return newptr;
 }
 
+// memalign - Over-allocates by the alignment and a free block's worth,
+// frees the lead up to the first aligned payload that leaves room for a
+// free block, and trims the tail.
+void * my_memalign(size_t alignment, size_t size) {
+  size_t keep = max(ALIGN(size + HEADER_SIZE), MIN_ALLOC_SIZE);
+  char *p = my_malloc(keep + alignment + MIN_BLOCK_SIZE);
+  if (p == NULL)
+    return NULL;
+  Header* b = (Header*)(p - HEADER_SIZE);
+  uintptr_t aligned =
+      ((uintptr_t)p + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  if (aligned != (uintptr_t)p) {
+    while (aligned - (uintptr_t)p < MIN_BLOCK_SIZE)
+      aligned += alignment;
+    size_t lead = aligned - (uintptr_t)p;
+    Header* rest = (Header*)((char*)b + lead);
+    rest->size = (SIZE(b->size) - lead) | USED | PREV_USED;
+    b->size = lead | (b->size & FLAGS);
+    free_block(b);
+    b = rest;
+  }
+  trim(b, keep);
+  return (char*)b + HEADER_SIZE;
+}
+
+// usable_size - everything after the header belongs to the payload.  The
+// flag bits may change under a concurrent neighbour's free, but the size
+// bits are fixed while the block is allocated.
+size_t my_usable_size(void *ptr) {
+  Header* b = (Header*)((char*)ptr - HEADER_SIZE);
+  return SIZE(__atomic_load_n(&b->size, __ATOMIC_RELAXED)) - HEADER_SIZE;
+}
+
 // call mem_reset_brk.
 void my_reset_brk() {
   mem_reset_brk();
@@ -0,0 +1,43 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// The range strategy: range_alloc.h, segregated fits over log-linear size
+// classes with boundary-tag coalescing.  Its entry points are renamed so
+// that allocator.c can choose it at runtime alongside the others.
+#define my_init range_init
+#define my_malloc range_malloc
+#define my_realloc range_realloc
+#define my_free range_free
+#define my_check range_check
+#define my_reset_brk range_reset_brk
+#define my_heap_lo range_heap_lo
+#define my_heap_hi range_heap_hi
+#define my_usable_size range_usable_size
+#define my_memalign range_memalign
+#define my_set_class range_set_class
+
+// Heaps with no trace class learn range_alloc.h's thresholds at runtime.
+#ifndef ADAPTIVE
+#define ADAPTIVE 1
+#endif
+
+#include "./range_alloc.h"
@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef _SIZE_CLASS_H
+#define _SIZE_CLASS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size-to-bin mapping shared by the allocators and by binbench.
+// Bin k holds sizes in (2^(k-1), 2^k], i.e. the bin is the upper bound
+// of lg(size).  size_to_class() further splits each of those octaves into
+// SUB_BINS equal log-linear classes.
+
+// Each power-of-two octave is split into 2^SUB_BIN_BITS classes.
+// 0 gives plain power-of-two bins.
+#ifndef SUB_BIN_BITS
+#define SUB_BIN_BITS 2
+#endif
+#define SUB_BINS (1 << SUB_BIN_BITS)
+
+// Number of classes needed for sizes up to 2^(octaves - 1).
+#define NUM_CLASSES(octaves) (((octaves) - SUB_BIN_BITS) * SUB_BINS)
+
+// Number of bits in a size_t.
+#define SIZE_T_BITS (sizeof(size_t) * 8)
+
+// Sizes in (SMALL_BIN_GRAIN, SMALL_BIN_MAX] are looked up in a table with
+// one entry per SMALL_BIN_GRAIN bytes; everything else goes through clz.
+#define SMALL_BIN_GRAIN 8
+#define SMALL_BIN_MAX 1024
+#define SMALL_BIN_ENTRIES (SMALL_BIN_MAX / SMALL_BIN_GRAIN)
+
+// Upper bound of lg(x) as a constant expression, valid for x <= 2^12.
+// Only used to build and check the lookup table below.
+#define CEIL_LOG2_CONST(x) \
+  ((x) <= 1 ? 0 : (x) <= 2 ? 1 : (x) <= 4 ? 2 : (x) <= 8 ? 3 : \
+   (x) <= 16 ? 4 : (x) <= 32 ? 5 : (x) <= 64 ? 6 : (x) <= 128 ? 7 : \
+   (x) <= 256 ? 8 : (x) <= 512 ? 9 : (x) <= 1024 ? 10 : \
+   (x) <= 2048 ? 11 : 12)
+
+// Entry g covers sizes (g * SMALL_BIN_GRAIN, (g + 1) * SMALL_BIN_GRAIN].
+// Since every power of two above SMALL_BIN_GRAIN is a multiple of it, the
+// bin is the same for the whole range once g > 0.
+#define SMALL_BIN(g) CEIL_LOG2_CONST(((g) + 1) * SMALL_BIN_GRAIN)
+#define SMALL_BIN_ROW(g) \
+  SMALL_BIN(g), SMALL_BIN((g) + 1), SMALL_BIN((g) + 2), SMALL_BIN((g) + 3), \
+  SMALL_BIN((g) + 4), SMALL_BIN((g) + 5), SMALL_BIN((g) + 6), SMALL_BIN((g) + 7)
+
+static const uint8_t small_bin_table[] = {
+  SMALL_BIN_ROW(0),   SMALL_BIN_ROW(8),   SMALL_BIN_ROW(16),  SMALL_BIN_ROW(24),
+  SMALL_BIN_ROW(32),  SMALL_BIN_ROW(40),  SMALL_BIN_ROW(48),  SMALL_BIN_ROW(56),
+  SMALL_BIN_ROW(64),  SMALL_BIN_ROW(72),  SMALL_BIN_ROW(80),  SMALL_BIN_ROW(88),
+  SMALL_BIN_ROW(96),  SMALL_BIN_ROW(104), SMALL_BIN_ROW(112), SMALL_BIN_ROW(120),
+};
+
+_Static_assert(sizeof(small_bin_table) == SMALL_BIN_ENTRIES,
+               "small_bin_table must cover exactly (0, SMALL_BIN_MAX]");
+_Static_assert((SMALL_BIN_GRAIN & (SMALL_BIN_GRAIN - 1)) == 0,
+               "SMALL_BIN_GRAIN must be a power of two");
+_Static_assert(SMALL_BIN(SMALL_BIN_ENTRIES - 1) == CEIL_LOG2_CONST(SMALL_BIN_MAX),
+               "last small_bin_table entry must match SMALL_BIN_MAX");
+
+// Upper bound of lg(val) for any val > 0, using count-leading-zeros.
+static inline size_t ceil_log2(size_t val) {
+  if (val <= 1)
+    return 0;
+  return SIZE_T_BITS - __builtin_clzl(val - 1);
+}
+
+// Returns the bin for size, i.e. the smallest k with size <= 2^k.
+static inline size_t size_to_bin(size_t size) {
+  // Unsigned wrap-around folds the (SMALL_BIN_GRAIN, SMALL_BIN_MAX] range
+  // check into a single comparison.
+  if (size - (SMALL_BIN_GRAIN + 1) < SMALL_BIN_MAX - SMALL_BIN_GRAIN)
+    return small_bin_table[(size - 1) / SMALL_BIN_GRAIN];
+  return ceil_log2(size);
+}
+
+// Returns the log-linear class for size > 0.  Sizes up to SUB_BINS get a
+// class each; above that, the octave (2^(k-1), 2^k] is cut into SUB_BINS
+// ranges of 2^(k-1-SUB_BIN_BITS) bytes.  Classes are contiguous and ordered
+// by size, so every size in class c + 1 exceeds every size in class c.
+static inline size_t size_to_class(size_t size) {
+  if (size <= SUB_BINS)
+    return size - 1;
+  size_t shift = size_to_bin(size) - 1 - SUB_BIN_BITS;
+  return (shift << SUB_BIN_BITS) + ((size - 1) >> shift);
+}
+
+#endif  // _SIZE_CLASS_H
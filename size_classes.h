@@ -0,0 +1,237 @@
+// Generated by sizegen -k 8 from traces additional_traces.  Do not edit; run make classes.
+
+#ifndef _SIZE_CLASSES_H
+#define _SIZE_CLASSES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A gen_table_t lists the payload size of each class in ascending
+// order.  lut[g] is the class of payloads in ((g - 1) * GEN_LUT_GRAIN,
+// g * GEN_LUT_GRAIN]; larger payloads search size.
+#define GEN_LUT_GRAIN 8
+#define GEN_LUT_MAX 1024
+#define GEN_LUT_ENTRIES (GEN_LUT_MAX / GEN_LUT_GRAIN + 1)
+
+typedef struct {
+  size_t num_classes;
+  const size_t *size;
+  const uint8_t *lut;
+} gen_table_t;
+
+// 2 traces, 23 distinct sizes, 1.03% internal fragmentation.
+static const size_t gen_class_size_c0[20] = {
+  24, 160, 456, 2040, 4072, 5672, 10856, 21608,
+  32768, 65536, 131072, 262144, 524288, 1048576, 2097152, 4194304,
+  8388608, 16777216, 33554432, 67108864,
+};
+static const uint8_t gen_class_lut_c0[GEN_LUT_ENTRIES] = {
+  0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3,
+  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+  3,
+};
+
+// 2 traces, 74 distinct sizes, 6.24% internal fragmentation.
+static const size_t gen_class_size_c1[20] = {
+  88, 144, 1120, 1472, 1696, 6472, 8192, 32640,
+  32768, 65536, 131072, 262144, 524288, 1048576, 2097152, 4194304,
+  8388608, 16777216, 33554432, 67108864,
+};
+static const uint8_t gen_class_lut_c1[GEN_LUT_ENTRIES] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1,
+  1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2,
+};
+
+// 2 traces, 2855 distinct sizes, 12.07% internal fragmentation.
+static const size_t gen_class_size_c2[20] = {
+  3920, 8112, 12352, 16432, 20512, 24536, 28864, 32760,
+  32768, 65536, 131072, 262144, 524288, 1048576, 2097152, 4194304,
+  8388608, 16777216, 33554432, 67108864,
+};
+static const uint8_t gen_class_lut_c2[GEN_LUT_ENTRIES] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0,
+};
+
+// 2 traces, 167 distinct sizes, 9.76% internal fragmentation.
+static const size_t gen_class_size_c3[20] = {
+  64, 512, 1024, 7224, 12648, 18992, 25000, 32560,
+  32768, 65536, 131072, 262144, 524288, 1048576, 2097152, 4194304,
+  8388608, 16777216, 33554432, 67108864,
+};
+static const uint8_t gen_class_lut_c3[GEN_LUT_ENTRIES] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2,
+};
+
+// 2 traces, 404 distinct sizes, 11.01% internal fragmentation.
+static const size_t gen_class_size_c4[20] = {
+  32, 1024, 6576, 12728, 18424, 23656, 28856, 32720,
+  32768, 65536, 131072, 262144, 524288, 1048576, 2097152, 4194304,
+  8388608, 16777216, 33554432, 67108864,
+};
+static const uint8_t gen_class_lut_c4[GEN_LUT_ENTRIES] = {
+  0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1,
+};
+
+// 2 traces, 125 distinct sizes, 11.11% internal fragmentation.
+static const size_t gen_class_size_c5[20] = {
+  120, 504, 1320, 1616, 2096, 2552, 8192, 32640,
+  32768, 65536, 131072, 262144, 524288, 1048576, 2097152, 4194304,
+  8388608, 16777216, 33554432, 67108864,
+};
+static const uint8_t gen_class_lut_c5[GEN_LUT_ENTRIES] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+  2,
+};
+
+// 2 traces, 120 distinct sizes, 11.94% internal fragmentation.
+static const size_t gen_class_size_c6[20] = {
+  64, 4288, 6992, 11968, 15624, 22600, 27248, 32592,
+  32768, 65536, 131072, 262144, 524288, 1048576, 2097152, 4194304,
+  8388608, 16777216, 33554432, 67108864,
+};
+static const uint8_t gen_class_lut_c6[GEN_LUT_ENTRIES] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1,
+};
+
+// 2 traces, 1635 distinct sizes, 15.03% internal fragmentation.
+static const size_t gen_class_size_c7[18] = {
+  2560, 5208, 10560, 18528, 25008, 37256, 49608, 65864,
+  131072, 262144, 524288, 1048576, 2097152, 4194304, 8388608, 16777216,
+  33554432, 67108864,
+};
+static const uint8_t gen_class_lut_c7[GEN_LUT_ENTRIES] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0,
+};
+
+// 2 traces, 90 distinct sizes, 15.18% internal fragmentation.
+static const size_t gen_class_size_c8[20] = {
+  8, 64, 128, 7552, 15616, 22632, 27776, 32536,
+  32768, 65536, 131072, 262144, 524288, 1048576, 2097152, 4194304,
+  8388608, 16777216, 33554432, 67108864,
+};
+static const uint8_t gen_class_lut_c8[GEN_LUT_ENTRIES] = {
+  0, 0, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2,
+  2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+  3,
+};
+
+// 2 traces, 7614 distinct sizes, 15.14% internal fragmentation.
+static const size_t gen_class_size_c9[15] = {
+  28088, 111744, 195584, 279424, 363264, 447104, 530944, 614784,
+  1048576, 2097152, 4194304, 8388608, 16777216, 33554432, 67108864,
+};
+static const uint8_t gen_class_lut_c9[GEN_LUT_ENTRIES] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0,
+};
+
+// 20 traces, 8815 distinct sizes, 25.71% internal fragmentation.
+static const size_t gen_class_size_any[15] = {
+  1024, 17336, 35016, 131456, 252288, 373120, 493952, 614784,
+  1048576, 2097152, 4194304, 8388608, 16777216, 33554432, 67108864,
+};
+static const uint8_t gen_class_lut_any[GEN_LUT_ENTRIES] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0,
+};
+
+#define GEN_NUM_TRACE_CLASSES 10
+#define GEN_MAX_CLASSES 20
+
+// gen_tables[c] serves trace class c, and gen_tables[GEN_NUM_TRACE_CLASSES]
+// any other class.
+static const gen_table_t gen_tables[GEN_NUM_TRACE_CLASSES + 1] = {
+  {20, gen_class_size_c0, gen_class_lut_c0},
+  {20, gen_class_size_c1, gen_class_lut_c1},
+  {20, gen_class_size_c2, gen_class_lut_c2},
+  {20, gen_class_size_c3, gen_class_lut_c3},
+  {20, gen_class_size_c4, gen_class_lut_c4},
+  {20, gen_class_size_c5, gen_class_lut_c5},
+  {20, gen_class_size_c6, gen_class_lut_c6},
+  {18, gen_class_size_c7, gen_class_lut_c7},
+  {20, gen_class_size_c8, gen_class_lut_c8},
+  {15, gen_class_size_c9, gen_class_lut_c9},
+  {15, gen_class_size_any, gen_class_lut_any},
+};
+
+#endif  // _SIZE_CLASSES_H
@@ -0,0 +1,425 @@
+// Copyright (c) 2012 MIT License by 6.172 Staff
+
+// sizegen - derives size classes from traces and writes them out as a
+// header for pow2_alloc.h.
+//
+// For every trace it replays the a/r/f ops and records, per aligned
+// request size, the peak number of blocks of that size live at once.
+// Summed over the traces of a trace class, those peaks weight each size by
+// how much heap it can pin down.  The K classes that minimise the weighted
+// internal fragmentation, sum of weight * (class - size), are then found
+// with a dynamic program over the sorted sizes.  The optimal split points
+// are monotone, so each of the K rounds is solved by divide and conquer in
+// O(n log n).  Above the largest size seen the classes just double, so any
+// request still gets a class.
+//
+// Traces named *_c<N>_* belong to trace class N.  Every trace also feeds
+// the table used when TRACE_CLASS matches none of them.
+//
+// Usage: ./sizegen [-k <classes>] [-o <header>] [<dir> ...]
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./trace_reader.h"
+
+#define GEN_ALIGN(size) (((size) + 7) & ~(size_t)7)
+// The smallest class must hold a free list node.
+#define GEN_MIN_SIZE 8
+// Must match GEN_LUT_GRAIN and GEN_LUT_MAX in the generated header.
+#define LUT_GRAIN 8
+#define LUT_MAX 1024
+// The doubling tail stops once it covers any request a 50 MB heap allows.
+#define TAIL_MAX ((size_t)1 << 26)
+#define NUM_TRACE_CLASSES 10
+#define MAX_CLASSES 255
+
+typedef struct {
+  size_t *sizes;     // sorted distinct aligned sizes
+  uint64_t *weight;  // summed peak live count of each size
+  size_t n;
+  size_t cap;
+  int traces;
+} histogram_t;
+
+static histogram_t hists[NUM_TRACE_CLASSES + 1];
+
+static int cmp_size(const void *a, const void *b) {
+  size_t x = *(const size_t *)a, y = *(const size_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Returns the index of size in the sorted array, which must hold it.
+static size_t find_size(const size_t *sizes, size_t n, size_t size) {
+  size_t lo = 0, hi = n;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (sizes[mid] < size)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void add_weight(histogram_t *h, size_t size, uint64_t weight) {
+  size_t i = find_size(h->sizes, h->n, size);
+  if (i < h->n && h->sizes[i] == size) {
+    h->weight[i] += weight;
+    return;
+  }
+  if (h->n == h->cap) {
+    h->cap = h->cap ? 2 * h->cap : 256;
+    h->sizes = (size_t *)realloc(h->sizes, h->cap * sizeof(size_t));
+    h->weight = (uint64_t *)realloc(h->weight, h->cap * sizeof(uint64_t));
+  }
+  memmove(h->sizes + i + 1, h->sizes + i, (h->n - i) * sizeof(size_t));
+  memmove(h->weight + i + 1, h->weight + i, (h->n - i) * sizeof(uint64_t));
+  h->sizes[i] = size;
+  h->weight[i] = weight;
+  h->n++;
+}
+
+static size_t request_size(size_t size) {
+  size_t aligned = GEN_ALIGN(size);
+  return aligned < GEN_MIN_SIZE ? GEN_MIN_SIZE : aligned;
+}
+
+// Replays the trace at path and adds the peak live count of each of its
+// sizes to the histograms it belongs to.
+static int read_trace(const char *path, int trace_class) {
+  FILE *f = fopen(path, "r");
+  trace_req_t req;
+  int header[4];
+
+  if (!f)
+    return -1;
+  if (fscanf(f, "%d %d %d %d", &header[0], &header[1],
+             &header[2], &header[3]) != 4 || header[1] <= 0) {
+    fclose(f);
+    return -1;
+  }
+
+  // First pass: the distinct sizes of the trace.
+  size_t n = 0;
+  size_t *sizes = (size_t *)malloc((header[2] + 1) * sizeof(size_t));
+  long ops_start = ftell(f);
+  while (read_request(f, &req) > 0) {
+    if (request_allocates(&req) && (int)n < header[2])
+      sizes[n++] = request_size(request_bytes(&req));
+  }
+  qsort(sizes, n, sizeof(size_t), cmp_size);
+  size_t distinct = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (!distinct || sizes[distinct - 1] != sizes[i])
+      sizes[distinct++] = sizes[i];
+  }
+
+  // Second pass: live and peak counts per size.
+  uint64_t *live = (uint64_t *)calloc(distinct + 1, sizeof(uint64_t));
+  uint64_t *peak = (uint64_t *)calloc(distinct + 1, sizeof(uint64_t));
+  // Size index of each id, or distinct while the id is not allocated.
+  size_t *id_size = (size_t *)malloc(header[1] * sizeof(size_t));
+  for (int i = 0; i < header[1]; i++)
+    id_size[i] = distinct;
+
+  fseek(f, ops_start, SEEK_SET);
+  while (read_request(f, &req) > 0) {
+    if (req.type == 'f') {
+      if (req.index < (unsigned)header[1]) {
+        live[id_size[req.index]]--;
+        id_size[req.index] = distinct;
+      }
+      continue;
+    }
+    if (!request_allocates(&req) || req.index >= (unsigned)header[1])
+      continue;
+    size_t s = find_size(sizes, distinct, request_size(request_bytes(&req)));
+    live[id_size[req.index]]--;
+    id_size[req.index] = s;
+    if (++live[s] > peak[s])
+      peak[s] = live[s];
+  }
+  fclose(f);
+
+  for (size_t i = 0; i < distinct; i++) {
+    add_weight(&hists[NUM_TRACE_CLASSES], sizes[i], peak[i]);
+    if (trace_class >= 0)
+      add_weight(&hists[trace_class], sizes[i], peak[i]);
+  }
+  hists[NUM_TRACE_CLASSES].traces++;
+  if (trace_class >= 0)
+    hists[trace_class].traces++;
+
+  free(sizes);
+  free(live);
+  free(peak);
+  free(id_size);
+  return 0;
+}
+
+// Prefix sums of weight and weight * size, so the fragmentation of giving
+// sizes a..b the class sizes[b] is O(1).
+static uint64_t *prefix_w, *prefix_ws;
+static const size_t *dp_sizes;
+static uint64_t *dp_prev, *dp_cur;
+static size_t *dp_split;
+
+static uint64_t waste(size_t a, size_t b) {
+  return dp_sizes[b] * (prefix_w[b + 1] - prefix_w[a]) -
+      (prefix_ws[b + 1] - prefix_ws[a]);
+}
+
+// Fills dp_cur[i] for lo <= i <= hi, knowing the best first size of the
+// last class lies in [opt_lo, opt_hi].
+static void solve(size_t lo, size_t hi, size_t opt_lo, size_t opt_hi) {
+  if (lo > hi)
+    return;
+  size_t mid = (lo + hi) / 2;
+  size_t best_p = opt_lo;
+  uint64_t best = UINT64_MAX;
+  for (size_t p = opt_lo; p <= opt_hi && p <= mid; p++) {
+    uint64_t cost = (p ? dp_prev[p - 1] : 0) + waste(p, mid);
+    if (cost < best) {
+      best = cost;
+      best_p = p;
+    }
+  }
+  dp_cur[mid] = best;
+  dp_split[mid] = best_p;
+  if (mid > lo)
+    solve(lo, mid - 1, opt_lo, best_p);
+  solve(mid + 1, hi, best_p, opt_hi);
+}
+
+// Picks at most k classes from h's sizes, always including the largest,
+// and writes them to classes in ascending order.  Returns their number.
+static size_t pick_classes(const histogram_t *h, size_t k, size_t *classes,
+                           double *frag) {
+  size_t n = h->n;
+  uint64_t total = 0;
+
+  if (k >= n) {
+    memcpy(classes, h->sizes, n * sizeof(size_t));
+    *frag = 0;
+    return n;
+  }
+
+  prefix_w = (uint64_t *)calloc(n + 1, sizeof(uint64_t));
+  prefix_ws = (uint64_t *)calloc(n + 1, sizeof(uint64_t));
+  for (size_t i = 0; i < n; i++) {
+    prefix_w[i + 1] = prefix_w[i] + h->weight[i];
+    prefix_ws[i + 1] = prefix_ws[i] + h->weight[i] * h->sizes[i];
+  }
+  total = prefix_ws[n];
+  dp_sizes = h->sizes;
+  dp_prev = (uint64_t *)malloc(n * sizeof(uint64_t));
+  dp_cur = (uint64_t *)malloc(n * sizeof(uint64_t));
+  size_t *split = (size_t *)malloc(k * n * sizeof(size_t));
+
+  // Round j gives the best cost of covering sizes 0..i with j + 1
+  // classes, the last of which is sizes[i].
+  for (size_t i = 0; i < n; i++) {
+    dp_prev[i] = waste(0, i);
+    split[i] = 0;
+  }
+  for (size_t j = 1; j < k; j++) {
+    dp_split = split + j * n;
+    solve(0, n - 1, 0, n - 1);
+    uint64_t *t = dp_prev;
+    dp_prev = dp_cur;
+    dp_cur = t;
+  }
+  *frag = total ? (double)dp_prev[n - 1] / total : 0;
+
+  // Walk the split points back from the largest size.
+  size_t count = 0;
+  size_t i = n - 1;
+  for (size_t j = k; j-- > 0;) {
+    classes[count++] = h->sizes[i];
+    size_t p = split[j * n + i];
+    if (p == 0)
+      break;
+    i = p - 1;
+  }
+  for (size_t a = 0, b = count - 1; a < b; a++, b--) {
+    size_t t = classes[a];
+    classes[a] = classes[b];
+    classes[b] = t;
+  }
+
+  free(prefix_w);
+  free(prefix_ws);
+  free(dp_prev);
+  free(dp_cur);
+  free(split);
+  return count;
+}
+
+// Writes the tables of one trace class, named with suffix, and returns
+// the number of classes.
+static size_t emit_table(FILE *out, const histogram_t *h, size_t k,
+                         const char *suffix) {
+  size_t classes[MAX_CLASSES];
+  double frag;
+  size_t count = 0;
+
+  if (h->n)
+    count = pick_classes(h, k, classes, &frag);
+  else
+    frag = 0;
+  size_t top = count ? classes[count - 1] : GEN_MIN_SIZE / 2;
+  for (size_t c = (size_t)1 << (64 - __builtin_clzl(top));
+       count < MAX_CLASSES; c *= 2) {
+    classes[count++] = c;
+    if (c >= TAIL_MAX)
+      break;
+  }
+
+  fprintf(out, "// %s: %d traces, %lu distinct sizes, %.2f%% internal "
+          "fragmentation.\n", suffix, h->traces, h->n, 100 * frag);
+  fprintf(out, "static const size_t gen_class_size_%s[%lu] = {", suffix,
+          count);
+  for (size_t i = 0; i < count; i++)
+    fprintf(out, "%s%lu,", i % 8 ? " " : "\n  ", classes[i]);
+  fprintf(out, "\n};\n");
+
+  fprintf(out, "static const uint8_t gen_class_lut_%s[GEN_LUT_ENTRIES] = {",
+          suffix);
+  size_t c = 0;
+  for (size_t g = 0; g <= LUT_MAX / LUT_GRAIN; g++) {
+    while (classes[c] < g * LUT_GRAIN)
+      c++;
+    fprintf(out, "%s%lu,", g % 16 ? " " : "\n  ", c);
+  }
+  fprintf(out, "\n};\n\n");
+  return count;
+}
+
+static void emit_header(FILE *out, size_t k, int argc, char **dirs) {
+  fprintf(out, "// Generated by sizegen -k %lu from", k);
+  for (int i = 0; i < argc; i++)
+    fprintf(out, " %s", dirs[i]);
+  fprintf(out, ".  Do not edit; run make classes.\n\n");
+  fprintf(out,
+          "#ifndef _SIZE_CLASSES_H\n"
+          "#define _SIZE_CLASSES_H\n\n"
+          "#include <stddef.h>\n"
+          "#include <stdint.h>\n\n"
+          "// A gen_table_t lists the payload size of each class in ascending\n"
+          "// order.  lut[g] is the class of payloads in ((g - 1) * "
+          "GEN_LUT_GRAIN,\n"
+          "// g * GEN_LUT_GRAIN]; larger payloads search size.\n"
+          "#define GEN_LUT_GRAIN %d\n"
+          "#define GEN_LUT_MAX %d\n"
+          "#define GEN_LUT_ENTRIES (GEN_LUT_MAX / GEN_LUT_GRAIN + 1)\n\n"
+          "typedef struct {\n"
+          "  size_t num_classes;\n"
+          "  const size_t *size;\n"
+          "  const uint8_t *lut;\n"
+          "} gen_table_t;\n\n",
+          LUT_GRAIN, LUT_MAX);
+
+  size_t counts[NUM_TRACE_CLASSES + 1];
+  size_t most = 0;
+  char suffix[16];
+  for (int tc = 0; tc <= NUM_TRACE_CLASSES; tc++) {
+    if (tc < NUM_TRACE_CLASSES && !hists[tc].traces)
+      continue;
+    if (tc < NUM_TRACE_CLASSES)
+      snprintf(suffix, sizeof(suffix), "c%d", tc);
+    else
+      snprintf(suffix, sizeof(suffix), "any");
+    counts[tc] = emit_table(out, &hists[tc], k, suffix);
+    if (counts[tc] > most)
+      most = counts[tc];
+  }
+
+  // Classes without traces get the table built from every trace.
+  fprintf(out, "#define GEN_NUM_TRACE_CLASSES %d\n", NUM_TRACE_CLASSES);
+  fprintf(out, "#define GEN_MAX_CLASSES %lu\n\n", most);
+  fprintf(out, "// gen_tables[c] serves trace class c, and "
+          "gen_tables[GEN_NUM_TRACE_CLASSES]\n"
+          "// any other class.\n");
+  fprintf(out, "static const gen_table_t "
+          "gen_tables[GEN_NUM_TRACE_CLASSES + 1] = {\n");
+  for (int tc = 0; tc <= NUM_TRACE_CLASSES; tc++) {
+    int own = tc < NUM_TRACE_CLASSES && hists[tc].traces;
+    if (own)
+      snprintf(suffix, sizeof(suffix), "c%d", tc);
+    else
+      snprintf(suffix, sizeof(suffix), "any");
+    fprintf(out, "  {%lu, gen_class_size_%s, gen_class_lut_%s},\n",
+            counts[own ? tc : NUM_TRACE_CLASSES], suffix, suffix);
+  }
+  fprintf(out, "};\n\n#endif  // _SIZE_CLASSES_H\n");
+}
+
+static void read_dir(const char *dir) {
+  DIR *dirp = opendir(dir);
+  struct dirent *entry;
+
+  if (!dirp) {
+    fprintf(stderr, "Cannot open directory '%s'\n", dir);
+    exit(EXIT_FAILURE);
+  }
+  while ((entry = readdir(dirp))) {
+    char path[2048];
+    const char *tag = strstr(entry->d_name, "_c");
+    int trace_class = -1;
+    if (entry->d_name[0] == '.')
+      continue;
+    if (tag && tag[2] >= '0' && tag[2] <= '9' && tag[3] == '_')
+      trace_class = tag[2] - '0';
+    snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+    if (read_trace(path, trace_class) < 0)
+      fprintf(stderr, "sizegen: skipping %s\n", path);
+  }
+  closedir(dirp);
+}
+
+int main(int argc, char **argv) {
+  char *default_dirs[] = {"traces", "additional_traces"};
+  char *outpath = NULL;
+  size_t k = 8;
+  int c;
+
+  while ((c = getopt(argc, argv, "k:o:h")) != EOF) {
+    switch (c) {
+      case 'k':
+        k = strtoul(optarg, NULL, 0);
+        break;
+      case 'o':
+        outpath = optarg;
+        break;
+      default:
+        fprintf(stderr, "Usage: sizegen [-k <classes>] [-o <header>] "
+                "[<dir> ...]\n");
+        exit(c == 'h' ? 0 : 1);
+    }
+  }
+  // Leave room for the doubling tail.
+  if (k < 1 || k > MAX_CLASSES - 32) {
+    fprintf(stderr, "sizegen: -k must be in [1, %d]\n", MAX_CLASSES - 32);
+    exit(1);
+  }
+
+  char **dirs = optind < argc ? argv + optind : default_dirs;
+  int num_dirs = optind < argc ? argc - optind : 2;
+  for (int i = 0; i < num_dirs; i++)
+    read_dir(dirs[i]);
+
+  FILE *out = outpath ? fopen(outpath, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "Cannot open '%s'\n", outpath);
+    exit(EXIT_FAILURE);
+  }
+  emit_header(out, k, num_dirs, dirs);
+  if (outpath)
+    fclose(out);
+  return 0;
+}
@@ -0,0 +1,297 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#ifndef _TLSF_H
+#define _TLSF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// The core of a two-level segregated fit heap, shared by
+// tlsf_allocator.c, which runs one Pool over the whole heap, and
+// arena_allocator.c, which runs one per arena.
+//
+// The first level splits sizes by power of two and the second splits each
+// power of two into SL_COUNT equal ranges.  One bitmap per level finds the
+// smallest non-empty list that is guaranteed to fit a request, so malloc,
+// free and coalescing never walk a list and run in bounded time.  Blocks
+// use the same boundary tags as range_alloc.h.
+
+#define ALIGNMENT 8
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
+
+// Each power of two is split into 2^SL_BITS lists.
+#define SL_BITS 4
+#define SL_COUNT (1 << SL_BITS)
+// Sizes below SMALL_SIZE all share first level 0, split linearly.
+#define FL_SHIFT (SL_BITS + 3)
+#define SMALL_SIZE (1 << FL_SHIFT)
+// 2^26 > 50 MB which is max size of alloc request.
+#define FL_MAX 26
+#define FL_COUNT (FL_MAX - FL_SHIFT + 1)
+
+#define USED 1
+#define PREV_USED 2
+#define FLAGS (USED | PREV_USED)
+#define SIZE(size) ((size) & ~FLAGS)
+
+// Allocated blocks hold only their size word.  Free blocks also hold list
+// links and a footer repeating their size.
+typedef struct Block {
+  size_t size;
+  struct Block* next;
+  struct Block* prev;
+} Block;
+
+#define HEADER_SIZE (ALIGN(sizeof(size_t)))
+#define FOOTER_SIZE (ALIGN(sizeof(size_t)))
+#define MIN_BLOCK_SIZE (ALIGN(sizeof(Block) + FOOTER_SIZE))
+
+// The free lists of one heap.  Bit f of FLMap is set iff some list of
+// first level f is non-empty, and bit s of SLMap[f] iff FreeList[f][s] is.
+typedef struct {
+  Block* FreeList[FL_COUNT][SL_COUNT];
+  uint32_t FLMap;
+  uint32_t SLMap[FL_COUNT];
+} Pool;
+
+static inline int fls_size(size_t size) {
+  return 63 - __builtin_clzl(size);
+}
+
+// Finds the list a free block of the given size belongs in.
+static inline void mapping_insert(size_t size, int* fl, int* sl) {
+  if (size < SMALL_SIZE) {
+    *fl = 0;
+    *sl = size / (SMALL_SIZE / SL_COUNT);
+  } else {
+    int f = fls_size(size);
+    *sl = (size >> (f - SL_BITS)) ^ SL_COUNT;
+    *fl = f - FL_SHIFT + 1;
+  }
+}
+
+// Finds the first list whose blocks are all at least size bytes, by
+// rounding size up to the next list boundary.
+static inline void mapping_search(size_t size, int* fl, int* sl) {
+  if (size >= SMALL_SIZE)
+    size += ((size_t)1 << (fls_size(size) - SL_BITS)) - 1;
+  mapping_insert(size, fl, sl);
+}
+
+// Returns a block from the first non-empty list at or after (fl, sl), or
+// NULL, with two find-first-set operations.
+static inline Block* search_suitable(Pool* p, int* fl, int* sl) {
+  if (*fl >= FL_COUNT)
+    return NULL;
+  uint32_t sl_map = p->SLMap[*fl] & (~0U << *sl);
+  if (!sl_map) {
+    uint32_t fl_map = p->FLMap & (~0U << (*fl + 1));
+    if (!fl_map)
+      return NULL;
+    *fl = __builtin_ctz(fl_map);
+    sl_map = p->SLMap[*fl];
+  }
+  *sl = __builtin_ctz(sl_map);
+  return p->FreeList[*fl][*sl];
+}
+
+static inline Block* next_block(Block* b) {
+  return (Block*)((char*)b + SIZE(b->size));
+}
+
+static inline void insert_block(Pool* p, Block* b) {
+  int fl, sl;
+  mapping_insert(SIZE(b->size), &fl, &sl);
+  b->prev = NULL;
+  b->next = p->FreeList[fl][sl];
+  if (b->next)
+    b->next->prev = b;
+  p->FreeList[fl][sl] = b;
+  p->FLMap |= 1U << fl;
+  p->SLMap[fl] |= 1U << sl;
+}
+
+static inline void remove_block(Pool* p, Block* b) {
+  int fl, sl;
+  mapping_insert(SIZE(b->size), &fl, &sl);
+  if (b->prev)
+    b->prev->next = b->next;
+  else
+    p->FreeList[fl][sl] = b->next;
+  if (b->next)
+    b->next->prev = b->prev;
+  if (!p->FreeList[fl][sl]) {
+    p->SLMap[fl] &= ~(1U << sl);
+    if (!p->SLMap[fl])
+      p->FLMap &= ~(1U << fl);
+  }
+}
+
+// Sets or clears the PREV_USED bit of b, which may be allocated.  A
+// thread-safe build reads an allocated block's size word without the
+// lock (usable_size), so there the bit is flipped atomically.
+static inline void set_prev_used(Block* b, int used) {
+#if THREAD_SAFE
+  if (used)
+    __atomic_fetch_or(&b->size, PREV_USED, __ATOMIC_RELAXED);
+  else
+    __atomic_fetch_and(&b->size, ~(size_t)PREV_USED, __ATOMIC_RELAXED);
+#else
+  if (used)
+    b->size |= PREV_USED;
+  else
+    b->size &= ~PREV_USED;
+#endif
+}
+
+static inline void mark_used(Block* b) {
+  b->size |= USED;
+  set_prev_used(next_block(b), 1);
+}
+
+static inline void mark_free(Block* b) {
+  b->size &= ~USED;
+  *(size_t*)((char*)b + SIZE(b->size) - FOOTER_SIZE) = SIZE(b->size);
+  set_prev_used(next_block(b), 0);
+}
+
+// Merges the allocated block b with its free neighbours, marks the result
+// free and lists it.
+static void free_block(Pool* p, Block* b) {
+  size_t total = SIZE(b->size);
+  Block* right = (Block*)((char*)b + total);
+  if (!(right->size & USED)) {
+    remove_block(p, right);
+    total += SIZE(right->size);
+  }
+  if (!(b->size & PREV_USED)) {
+    size_t left_size = *(size_t*)((char*)b - FOOTER_SIZE);
+    b = (Block*)((char*)b - left_size);
+    remove_block(p, b);
+    total += left_size;
+  }
+  b->size = total | (b->size & FLAGS);
+  mark_free(b);
+  insert_block(p, b);
+}
+
+// Splits the surplus past aligned_size off the allocated block b and
+// frees it.
+static inline void trim(Pool* p, Block* b, size_t aligned_size) {
+  size_t surplus = SIZE(b->size) - aligned_size;
+  if (surplus < MIN_BLOCK_SIZE)
+    return;
+  Block* rest = (Block*)((char*)b + aligned_size);
+  rest->size = surplus | USED | PREV_USED;
+  b->size = aligned_size | (b->size & FLAGS);
+  free_block(p, rest);
+}
+
+// Frees the lead of the allocated block b up to the first payload aligned
+// to alignment that leaves room for a free block before it, and returns
+// the block that starts there.  b needs alignment + MIN_BLOCK_SIZE bytes
+// beyond what the caller will keep.
+static inline Block* align_block(Pool* p, Block* b, size_t alignment) {
+  uintptr_t payload = (uintptr_t)b + HEADER_SIZE;
+  uintptr_t aligned = (payload + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  if (aligned == payload)
+    return b;
+  while (aligned - payload < MIN_BLOCK_SIZE)
+    aligned += alignment;
+  size_t lead = aligned - payload;
+  Block* rest = (Block*)((char*)b + lead);
+  rest->size = (SIZE(b->size) - lead) | USED | PREV_USED;
+  b->size = lead | (b->size & FLAGS);
+  free_block(p, b);
+  return rest;
+}
+
+static inline size_t request_size(size_t size) {
+  size_t aligned_size = ALIGN(size + HEADER_SIZE);
+  return aligned_size < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : aligned_size;
+}
+
+// Walks the blocks from prologue to end checking the boundary tags, and
+// adds the free ones to *free_blocks.  Returns 0 if they are consistent.
+static int check_blocks(Block* prologue, Block* end, size_t* free_blocks) {
+  Block* b = prologue;
+  int prev_used = 1;
+
+  if (b->size != (HEADER_SIZE | USED | PREV_USED)) {
+    printf("Bad prologue at %p\n", b);
+    return -1;
+  }
+  for (b = next_block(b); b < end; b = next_block(b)) {
+    if (!!(b->size & PREV_USED) != prev_used) {
+      printf("Block %p has a stale PREV_USED bit\n", b);
+      return -1;
+    }
+    prev_used = b->size & USED;
+    if (!prev_used) {
+      (*free_blocks)++;
+      if (*(size_t*)((char*)b + SIZE(b->size) - FOOTER_SIZE) !=
+          SIZE(b->size) || !(next_block(b)->size & USED)) {
+        printf("Free block %p has a bad footer or free neighbour\n", b);
+        return -1;
+      }
+    }
+  }
+  if (b != end || SIZE(end->size) != 0 ||
+      !!(end->size & PREV_USED) != prev_used) {
+    printf("Blocks did not end at the epilogue %p\n", end);
+    return -1;
+  }
+  return 0;
+}
+
+// Checks that every listed block is free and in its mapped list, and that
+// the bitmaps match the lists.  Subtracts the listed blocks from
+// *free_blocks.
+static int check_pool(Pool* p, size_t* free_blocks) {
+  for (int fl = 0; fl < FL_COUNT; fl++) {
+    if (!!(p->FLMap & (1U << fl)) != !!p->SLMap[fl]) {
+      printf("FLMap disagrees with SLMap[%d]\n", fl);
+      return -1;
+    }
+    for (int sl = 0; sl < SL_COUNT; sl++) {
+      if (!!(p->SLMap[fl] & (1U << sl)) != !!p->FreeList[fl][sl]) {
+        printf("SLMap disagrees with FreeList[%d][%d]\n", fl, sl);
+        return -1;
+      }
+      for (Block* b = p->FreeList[fl][sl]; b; b = b->next) {
+        int f, s;
+        mapping_insert(SIZE(b->size), &f, &s);
+        if ((b->size & USED) || f != fl || s != sl ||
+            (b->next && b->next->prev != b)) {
+          printf("FreeList[%d][%d] had a bad block %p\n", fl, sl, b);
+          return -1;
+        }
+        (*free_blocks)--;
+      }
+    }
+  }
+  return 0;
+}
+
+#endif  // _TLSF_H
@@ -0,0 +1,189 @@
+/**
+ * Copyright (c) 2012 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./allocator_interface.h"
+#include "./memlib.h"
+#include "./tlsf.h"
+
+// Don't call libc malloc!
+#define malloc(...) (USE_TLSF_MALLOC)
+#define free(...) (USE_TLSF_FREE)
+#define realloc(...) (USE_TLSF_REALLOC)
+
+// TLSF as a strategy of its own: one pool over the whole heap, whose top
+// block grows with the brk.
+static Pool pool;
+// The prologue, which is heap_lo unless another strategy owns the heap
+// below it.
+static Block* heap_base;
+
+static inline Block* epilogue() {
+  return (Block*)((char*)mem_heap_hi() + 1 - HEADER_SIZE);
+}
+
+// check - Walks the heap checking the boundary tags, then checks the lists
+// against it.
+int tlsf_check() {
+  size_t free_blocks = 0;
+
+  if (check_blocks(heap_base, epilogue(), &free_blocks) < 0 ||
+      check_pool(&pool, &free_blocks) < 0)
+    return -1;
+  if (free_blocks) {
+    printf("Free blocks in the heap and in the lists disagree\n");
+    return -1;
+  }
+  return 0;
+}
+
+// init - Empties the lists and lays down the prologue and epilogue.
+int tlsf_init() {
+  memset(&pool, 0, sizeof(pool));
+  Block* prologue = mem_sbrk(2 * HEADER_SIZE);
+  if (prologue == (void *)-1)
+    return -1;
+  prologue->size = HEADER_SIZE | USED | PREV_USED;
+  heap_base = prologue;
+  next_block(prologue)->size = USED | PREV_USED;
+  return 0;
+}
+
+// malloc - Takes the head of the first list that is guaranteed to fit,
+// or extends the heap (and a free top block) by the shortfall.
+void * tlsf_malloc(size_t size) {
+  size_t aligned_size = request_size(size);
+  int fl, sl;
+  Block* b;
+
+  mapping_search(aligned_size, &fl, &sl);
+  b = search_suitable(&pool, &fl, &sl);
+  if (b) {
+    remove_block(&pool, b);
+  } else {
+    Block* end = epilogue();
+    size_t top_size = 0;
+    if (!(end->size & PREV_USED)) {
+      top_size = *(size_t*)((char*)end - FOOTER_SIZE);
+      b = (Block*)((char*)end - top_size);
+    }
+    // The top block may already fit: the search skips the request's own
+    // list, whose blocks are not all large enough.
+    size_t grow = aligned_size > top_size ? aligned_size - top_size : 0;
+    if (grow && mem_sbrk(grow) == (void *)-1)
+      return NULL;
+    if (b)
+      remove_block(&pool, b);
+    else
+      b = end;
+    b->size = (top_size + grow) | (b->size & PREV_USED);
+    next_block(b)->size = USED;
+  }
+  mark_used(b);
+  trim(&pool, b, aligned_size);
+  return (char*)b + HEADER_SIZE;
+}
+
+// free - Coalesces with both neighbours in constant time.
+void tlsf_free(void *ptr) {
+  if (ptr)
+    free_block(&pool, (Block*)((char*)ptr - HEADER_SIZE));
+}
+
+// realloc - Shrinks in place, grows into a free right neighbour or past
+// the brk, and otherwise moves.
+void * tlsf_realloc(void *ptr, size_t size) {
+  if (!ptr)
+    return tlsf_malloc(size);
+
+  Block* b = (Block*)((char*)ptr - HEADER_SIZE);
+  size_t aligned_size = request_size(size);
+  size_t old_size = SIZE(b->size);
+  void *newptr;
+
+  if (aligned_size <= old_size) {
+    trim(&pool, b, aligned_size);
+    return ptr;
+  }
+
+  Block* right = next_block(b);
+  if (!(right->size & USED) && old_size + SIZE(right->size) >= aligned_size) {
+    remove_block(&pool, right);
+    b->size += SIZE(right->size);
+    mark_used(b);
+    trim(&pool, b, aligned_size);
+    return ptr;
+  }
+  if (right == epilogue()) {
+    if (mem_sbrk(aligned_size - old_size) == (void *)-1)
+      return NULL;
+    b->size += aligned_size - old_size;
+    next_block(b)->size = USED | PREV_USED;
+    return ptr;
+  }
+
+  newptr = tlsf_malloc(size);
+  if (NULL == newptr)
+    return NULL;
+  memcpy(newptr, ptr, old_size - HEADER_SIZE);
+  tlsf_free(ptr);
+  return newptr;
+}
+
+// memalign - Over-allocates, frees the lead before the aligned payload
+// and trims the tail.
+void * tlsf_memalign(size_t alignment, size_t size) {
+  size_t keep = request_size(size);
+  char *p = tlsf_malloc(keep + alignment + MIN_BLOCK_SIZE);
+  if (p == NULL)
+    return NULL;
+  Block* b = align_block(&pool, (Block*)(p - HEADER_SIZE), alignment);
+  trim(&pool, b, keep);
+  return (char*)b + HEADER_SIZE;
+}
+
+// usable_size - everything after the header belongs to the payload.  A
+// thread-safe build calls this without the heap lock, while neighbours
+// may rewrite the PREV_USED bit, so the word is loaded atomically.  The
+// size bits do not change while the block is allocated.
+size_t tlsf_usable_size(void *ptr) {
+  Block* b = (Block*)((char*)ptr - HEADER_SIZE);
+  return SIZE(__atomic_load_n(&b->size, __ATOMIC_RELAXED)) - HEADER_SIZE;
+}
+
+// call mem_reset_brk.
+void tlsf_reset_brk() {
+  mem_reset_brk();
+}
+
+// call mem_heap_lo
+void * tlsf_heap_lo() {
+  return mem_heap_lo();
+}
+
+// call mem_heap_hi
+void * tlsf_heap_hi() {
+  return mem_heap_hi();
+}
@@ -0,0 +1,82 @@
+#ifndef MM_TRACE_READER_H
+#define MM_TRACE_READER_H
+
+/*
+ * trace_reader.h - Reads the requests of a text trace, for mdriver,
+ *   binbench and sizegen alike.
+ *
+ * A request is an optional @{thread} and then +{gap} prefix, and one of
+ *   a {index} {size}          f {index}
+ *   r {index} {size}          w {index} {size}
+ *   c {index} {nmemb} {size}  m {index} {align} {size}
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* One request.  Fields the request does not have are 0. */
+typedef struct {
+  char type;        /* request letter */
+  unsigned index;   /* pointer id */
+  unsigned size;    /* bytes, or bytes per element for c */
+  unsigned nmemb;   /* elements of a c request */
+  unsigned align;   /* alignment of an m request */
+  int thread;       /* thread that made the request */
+  int has_thread;   /* set if the request had an @{thread} prefix */
+  unsigned gap;     /* ns since the thread's last request */
+} trace_req_t;
+
+/* Reads the next request from f, which is past the trace's header.
+   Returns 1 if it read one, 0 at the end of the trace, and -1 if the
+   request letter, left in req->type, is unknown. */
+static inline int read_request(FILE *f, trace_req_t *req) {
+  char tok[32];
+
+  memset(req, 0, sizeof(*req));
+  if (fscanf(f, "%31s", tok) != 1)
+    return 0;
+  if (tok[0] == '@') {
+    req->thread = atoi(tok + 1);
+    req->has_thread = 1;
+    if (fscanf(f, "%31s", tok) != 1)
+      return 0;
+  }
+  if (tok[0] == '+') {
+    req->gap = strtoul(tok + 1, NULL, 10);
+    if (fscanf(f, "%31s", tok) != 1)
+      return 0;
+  }
+  req->type = tok[0];
+  switch (tok[0]) {
+    case 'a':
+    case 'r':
+    case 'w':
+      fscanf(f, "%u %u", &req->index, &req->size);
+      return 1;
+    case 'f':
+      fscanf(f, "%u", &req->index);
+      return 1;
+    case 'c':
+      fscanf(f, "%u %u %u", &req->index, &req->nmemb, &req->size);
+      return 1;
+    case 'm':
+      fscanf(f, "%u %u %u", &req->index, &req->align, &req->size);
+      return 1;
+    default:
+      return -1;
+  }
+}
+
+/* Whether the request leaves a block of request_bytes at its index. */
+static inline int request_allocates(const trace_req_t *req) {
+  return req->type == 'a' || req->type == 'r' || req->type == 'c' ||
+         req->type == 'm';
+}
+
+/* The bytes the request asks for. */
+static inline size_t request_bytes(const trace_req_t *req) {
+  return req->type == 'c' ? (size_t)req->nmemb * req->size : req->size;
+}
+
+#endif /* MM_TRACE_READER_H */
@@ -151,13 +151,30 @@ int eval_mm_valid(const malloc_impl_t *impl, trace_t *trace, int tracenum) {
 
     switch (trace->ops[i].type) {
       case ALLOC:  // malloc
+      case CALLOC:
+      case MEMALIGN:
 
         // Call the student's malloc
-        if ((p = (char *) impl->malloc(size)) == NULL) {
+        if ((p = (char *) trace_alloc(impl, &trace->ops[i])) == NULL) {
           malloc_error(tracenum, i, "impl malloc failed.");
           return 0;
         }
 
+        // calloc must zero the block, and memalign must align it
+        if (trace->ops[i].type == CALLOC) {
+          for (int j = 0; j < size; j++) {
+            if (p[j] != 0) {
+              malloc_error(tracenum, i, "impl calloc returned a dirty block.");
+              return 0;
+            }
+          }
+        }
+        if (trace->ops[i].type == MEMALIGN && impl->memalign &&
+            (uintptr_t)p % trace->ops[i].align != 0) {
+          malloc_error(tracenum, i, "impl memalign returned a misaligned block.");
+          return 0;
+        }
+
         // Test the range of the new block for correctness and add it
         // to the range list if OK. The block must be  be aligned properly,
         // and must not overlap any currently allocated block.